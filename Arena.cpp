@@ -0,0 +1,114 @@
+#include "Arena.hpp"
+
+#include <algorithm>
+#include <cstdint>
+#include <cstdlib>
+
+namespace svg
+{
+    namespace
+    {
+        //! Largest block size, other than for single large allocations.
+        const size_t MAX_BLOCK_SIZE = (size_t)1 << 20;
+    }
+
+    Arena::Arena(size_t block_size)
+        : head_(nullptr), cur_(nullptr), end_(nullptr),
+          block_size_(block_size), first_block_size_(block_size),
+          used_(0), blocks_(0)
+    {
+    }
+    Arena::~Arena()
+    {
+        release();
+    }
+    void *Arena::allocate(size_t size, size_t align)
+    {
+        uintptr_t p = ((uintptr_t)cur_ + align - 1) & ~(uintptr_t)(align - 1);
+        if (cur_ == nullptr || p + size > (uintptr_t)end_)
+        {
+            grow(size, align);
+            p = ((uintptr_t)cur_ + align - 1) & ~(uintptr_t)(align - 1);
+        }
+        cur_ = (char *)(p + size);
+        used_ += size;
+        return (void *)p;
+    }
+    void Arena::grow(size_t size, size_t align)
+    {
+        size_t needed = sizeof(Block) + size + align;
+        size_t bytes = std::max(block_size_, needed);
+        Block *block = (Block *)std::malloc(bytes);
+        if (block == nullptr)
+        {
+            throw std::bad_alloc();
+        }
+        block->next = head_;
+        head_ = block;
+        cur_ = (char *)(block + 1);
+        end_ = (char *)block + bytes;
+        block_size_ = std::min(block_size_ * 2, MAX_BLOCK_SIZE);
+        blocks_++;
+    }
+    void Arena::give_back(char *end, size_t size)
+    {
+        if (end == cur_)
+        {
+            cur_ -= size;
+            used_ -= size;
+        }
+    }
+    void Arena::adopt(Arena &other)
+    {
+        if (other.head_ == nullptr)
+        {
+            return;
+        }
+        if (head_ == nullptr)
+        {
+            head_ = other.head_;
+            cur_ = other.cur_;
+            end_ = other.end_;
+            block_size_ = other.block_size_;
+        }
+        else
+        {
+            // The blocks go after the current one, which stays current.
+            Block *last = other.head_;
+            while (last->next != nullptr)
+            {
+                last = last->next;
+            }
+            last->next = head_->next;
+            head_->next = other.head_;
+        }
+        used_ += other.used_;
+        blocks_ += other.blocks_;
+        other.head_ = nullptr;
+        other.cur_ = other.end_ = nullptr;
+        other.block_size_ = other.first_block_size_;
+        other.used_ = 0;
+        other.blocks_ = 0;
+    }
+    void Arena::release()
+    {
+        while (head_ != nullptr)
+        {
+            Block *next = head_->next;
+            std::free(head_);
+            head_ = next;
+        }
+        cur_ = end_ = nullptr;
+        block_size_ = first_block_size_;
+        used_ = 0;
+        blocks_ = 0;
+    }
+    size_t Arena::bytes_used() const
+    {
+        return used_;
+    }
+    size_t Arena::blocks() const
+    {
+        return blocks_;
+    }
+}
@@ -0,0 +1,151 @@
+//! @file Arena.hpp
+#ifndef __svg_Arena_hpp__
+#define __svg_Arena_hpp__
+
+#include <cstddef>
+#include <new>
+#include <utility>
+
+namespace svg
+{
+    //! Contiguous sequence of objects stored elsewhere (usually in an
+    //! arena), with the interface of a fixed size container.
+    template <typename T>
+    struct Span
+    {
+        //! First object.
+        T *first;
+        //! Number of objects.
+        size_t count;
+
+        T *data() const { return first; }
+        size_t size() const { return count; }
+        bool empty() const { return count == 0; }
+        T *begin() const { return first; }
+        T *end() const { return first + count; }
+        T &operator[](size_t i) const { return first[i]; }
+    };
+
+    //! Monotonic allocator owning all the objects of a document.
+    //! Memory is taken from large blocks by bumping a pointer, and
+    //! is only given back when the arena is released, all at once.
+    //! Objects in the arena are never destroyed, so they must not
+    //! own other resources (such as std::vector members).
+    class Arena
+    {
+    public:
+        //! Constructor.
+        //! @param block_size Size of the first block; each new block
+        //! is twice as large as the previous one, up to 1 MiB.
+        explicit Arena(size_t block_size = 4096);
+        //! Destructor, releasing all memory.
+        ~Arena();
+        Arena(const Arena &) = delete;
+        Arena &operator=(const Arena &) = delete;
+        //! Allocate uninitialized memory.
+        //! @param size Number of bytes.
+        //! @param align Alignment, a power of 2.
+        //! @return Pointer to the memory.
+        void *allocate(size_t size, size_t align);
+        //! Construct an object in the arena.
+        //! @param args Arguments of the constructor.
+        //! @return Pointer to the object.
+        template <typename T, typename... Args>
+        T *create(Args &&...args)
+        {
+            return new (allocate(sizeof(T), alignof(T))) T(std::forward<Args>(args)...);
+        }
+        //! Construct an array of value-initialized objects in the arena.
+        //! @param n Number of objects.
+        //! @return The objects.
+        template <typename T>
+        Span<T> array(size_t n)
+        {
+            T *first = (T *)allocate(n * sizeof(T), alignof(T));
+            for (size_t i = 0; i < n; i++)
+            {
+                new (first + i) T();
+            }
+            return {first, n};
+        }
+        //! Copy an array of objects into the arena.
+        //! @param src Objects to copy.
+        //! @param n Number of objects.
+        //! @return The copies.
+        template <typename T>
+        Span<T> copy(const T *src, size_t n)
+        {
+            T *first = (T *)allocate(n * sizeof(T), alignof(T));
+            for (size_t i = 0; i < n; i++)
+            {
+                new (first + i) T(src[i]);
+            }
+            return {first, n};
+        }
+        //! Allocate an array of objects without initializing them, for
+        //! objects that are only assigned, such as points.
+        //! @param n Number of objects.
+        //! @return The objects.
+        template <typename T>
+        Span<T> uninitialized(size_t n)
+        {
+            return {(T *)allocate(n * sizeof(T), alignof(T)), n};
+        }
+        //! Shrink the most recent allocation, such as an array sized for
+        //! the largest possible number of objects, giving back the memory
+        //! of the objects after the first n.
+        //! @param objects Most recently allocated objects.
+        //! @param n Number of objects to keep.
+        //! @return The objects kept.
+        template <typename T>
+        Span<T> trim(Span<T> objects, size_t n)
+        {
+            give_back((char *)objects.end(), (objects.size() - n) * sizeof(T));
+            return {objects.data(), n};
+        }
+        //! Take over the memory of another arena, such as one filled by
+        //! another thread, so that its objects live as long as this one.
+        //! @param other Arena, left empty.
+        void adopt(Arena &other);
+        //! Release all memory; objects in the arena become invalid.
+        void release();
+        //! Get the number of bytes handed out since the last release.
+        //! @return Number of bytes.
+        size_t bytes_used() const;
+        //! Get the number of blocks allocated since the last release.
+        //! @return Number of blocks.
+        size_t blocks() const;
+
+    private:
+        //! Header of a block, followed by its memory.
+        struct Block
+        {
+            //! Previously allocated block.
+            Block *next;
+        };
+        //! Allocate a new block with room for at least size bytes.
+        //! @param size Number of bytes needed.
+        //! @param align Alignment needed.
+        void grow(size_t size, size_t align);
+        //! Give back the last bytes of the most recent allocation.
+        //! @param end End of the allocation.
+        //! @param size Number of bytes.
+        void give_back(char *end, size_t size);
+        //! Most recently allocated block.
+        Block *head_;
+        //! Next free byte of the current block.
+        char *cur_;
+        //! End of the current block.
+        char *end_;
+        //! Size of the next block.
+        size_t block_size_;
+        //! Size of the first block.
+        size_t first_block_size_;
+        //! Bytes handed out.
+        size_t used_;
+        //! Blocks allocated.
+        size_t blocks_;
+    };
+}
+
+#endif
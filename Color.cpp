@@ -1,34 +1,286 @@
 #include "Color.hpp"
-#include <map>
-#include <iomanip>
-#include <sstream>
+#include "Numbers.hpp"
+#include <cstdint>
+#include <cstring>
+#include <stdexcept>
 
 namespace svg
 {
-    const std::map<std::string, Color> NAMES_TO_COLORS = {
-        {"black", {0, 0, 0}},
-        {"white", {255, 255, 255}},
-        {"red", {255, 0, 0}},
-        {"green", {0, 255, 0}},
-        {"blue", {0, 0, 255}},
-        {"yellow", {255, 255, 0}}};
+    namespace
+    {
+        //! Named color, with its components packed as 0xRRGGBB.
+        struct NamedColor
+        {
+            const char *name;
+            uint32_t rgb;
+        };
+
+        //! The CSS color keywords, in alphabetical order. "green" keeps
+        //! the value it always had here (CSS "lime"), which the expected
+        //! images rely on, instead of the CSS value 0x008000.
+        const NamedColor NAMED_COLORS[] = {
+            {"aliceblue", 0xF0F8FF}, {"antiquewhite", 0xFAEBD7}, {"aqua", 0x00FFFF},
+            {"aquamarine", 0x7FFFD4}, {"azure", 0xF0FFFF}, {"beige", 0xF5F5DC},
+            {"bisque", 0xFFE4C4}, {"black", 0x000000}, {"blanchedalmond", 0xFFEBCD},
+            {"blue", 0x0000FF}, {"blueviolet", 0x8A2BE2}, {"brown", 0xA52A2A},
+            {"burlywood", 0xDEB887}, {"cadetblue", 0x5F9EA0}, {"chartreuse", 0x7FFF00},
+            {"chocolate", 0xD2691E}, {"coral", 0xFF7F50}, {"cornflowerblue", 0x6495ED},
+            {"cornsilk", 0xFFF8DC}, {"crimson", 0xDC143C}, {"cyan", 0x00FFFF},
+            {"darkblue", 0x00008B}, {"darkcyan", 0x008B8B}, {"darkgoldenrod", 0xB8860B},
+            {"darkgray", 0xA9A9A9}, {"darkgreen", 0x006400}, {"darkgrey", 0xA9A9A9},
+            {"darkkhaki", 0xBDB76B}, {"darkmagenta", 0x8B008B}, {"darkolivegreen", 0x556B2F},
+            {"darkorange", 0xFF8C00}, {"darkorchid", 0x9932CC}, {"darkred", 0x8B0000},
+            {"darksalmon", 0xE9967A}, {"darkseagreen", 0x8FBC8F}, {"darkslateblue", 0x483D8B},
+            {"darkslategray", 0x2F4F4F}, {"darkslategrey", 0x2F4F4F}, {"darkturquoise", 0x00CED1},
+            {"darkviolet", 0x9400D3}, {"deeppink", 0xFF1493}, {"deepskyblue", 0x00BFFF},
+            {"dimgray", 0x696969}, {"dimgrey", 0x696969}, {"dodgerblue", 0x1E90FF},
+            {"firebrick", 0xB22222}, {"floralwhite", 0xFFFAF0}, {"forestgreen", 0x228B22},
+            {"fuchsia", 0xFF00FF}, {"gainsboro", 0xDCDCDC}, {"ghostwhite", 0xF8F8FF},
+            {"gold", 0xFFD700}, {"goldenrod", 0xDAA520}, {"gray", 0x808080},
+            {"green", 0x00FF00}, {"greenyellow", 0xADFF2F}, {"grey", 0x808080},
+            {"honeydew", 0xF0FFF0}, {"hotpink", 0xFF69B4}, {"indianred", 0xCD5C5C},
+            {"indigo", 0x4B0082}, {"ivory", 0xFFFFF0}, {"khaki", 0xF0E68C},
+            {"lavender", 0xE6E6FA}, {"lavenderblush", 0xFFF0F5}, {"lawngreen", 0x7CFC00},
+            {"lemonchiffon", 0xFFFACD}, {"lightblue", 0xADD8E6}, {"lightcoral", 0xF08080},
+            {"lightcyan", 0xE0FFFF}, {"lightgoldenrodyellow", 0xFAFAD2}, {"lightgray", 0xD3D3D3},
+            {"lightgreen", 0x90EE90}, {"lightgrey", 0xD3D3D3}, {"lightpink", 0xFFB6C1},
+            {"lightsalmon", 0xFFA07A}, {"lightseagreen", 0x20B2AA}, {"lightskyblue", 0x87CEFA},
+            {"lightslategray", 0x778899}, {"lightslategrey", 0x778899}, {"lightsteelblue", 0xB0C4DE},
+            {"lightyellow", 0xFFFFE0}, {"lime", 0x00FF00}, {"limegreen", 0x32CD32},
+            {"linen", 0xFAF0E6}, {"magenta", 0xFF00FF}, {"maroon", 0x800000},
+            {"mediumaquamarine", 0x66CDAA}, {"mediumblue", 0x0000CD}, {"mediumorchid", 0xBA55D3},
+            {"mediumpurple", 0x9370DB}, {"mediumseagreen", 0x3CB371}, {"mediumslateblue", 0x7B68EE},
+            {"mediumspringgreen", 0x00FA9A}, {"mediumturquoise", 0x48D1CC}, {"mediumvioletred", 0xC71585},
+            {"midnightblue", 0x191970}, {"mintcream", 0xF5FFFA}, {"mistyrose", 0xFFE4E1},
+            {"moccasin", 0xFFE4B5}, {"navajowhite", 0xFFDEAD}, {"navy", 0x000080},
+            {"oldlace", 0xFDF5E6}, {"olive", 0x808000}, {"olivedrab", 0x6B8E23},
+            {"orange", 0xFFA500}, {"orangered", 0xFF4500}, {"orchid", 0xDA70D6},
+            {"palegoldenrod", 0xEEE8AA}, {"palegreen", 0x98FB98}, {"paleturquoise", 0xAFEEEE},
+            {"palevioletred", 0xDB7093}, {"papayawhip", 0xFFEFD5}, {"peachpuff", 0xFFDAB9},
+            {"peru", 0xCD853F}, {"pink", 0xFFC0CB}, {"plum", 0xDDA0DD},
+            {"powderblue", 0xB0E0E6}, {"purple", 0x800080}, {"rebeccapurple", 0x663399},
+            {"red", 0xFF0000}, {"rosybrown", 0xBC8F8F}, {"royalblue", 0x4169E1},
+            {"saddlebrown", 0x8B4513}, {"salmon", 0xFA8072}, {"sandybrown", 0xF4A460},
+            {"seagreen", 0x2E8B57}, {"seashell", 0xFFF5EE}, {"sienna", 0xA0522D},
+            {"silver", 0xC0C0C0}, {"skyblue", 0x87CEEB}, {"slateblue", 0x6A5ACD},
+            {"slategray", 0x708090}, {"slategrey", 0x708090}, {"snow", 0xFFFAFA},
+            {"springgreen", 0x00FF7F}, {"steelblue", 0x4682B4}, {"tan", 0xD2B48C},
+            {"teal", 0x008080}, {"thistle", 0xD8BFD8}, {"tomato", 0xFF6347},
+            {"turquoise", 0x40E0D0}, {"violet", 0xEE82EE}, {"wheat", 0xF5DEB3},
+            {"white", 0xFFFFFF}, {"whitesmoke", 0xF5F5F5}, {"yellow", 0xFFFF00},
+            {"yellowgreen", 0x9ACD32}};
+
+        //! Longest color name.
+        const size_t MAX_NAME_SIZE = 20;
+
+        //! Perfect hash of the color names: a name with hash h is in
+        //! bucket h % 64, whose displacement d puts it in slot
+        //! ((h >> 8) + d * ((h >> 16) | 1)) % 256. The displacements were
+        //! chosen (largest buckets first, smallest displacement that fits)
+        //! so that every name gets its own slot, and the slot holds the
+        //! index of the name plus one (0 for an empty slot). Other strings
+        //! are rejected by comparing them with the name of their slot.
+        const uint8_t NAME_DISPLACEMENTS[64] = {
+            0, 0, 0, 0, 8, 5, 1, 0, 0, 0, 0, 0, 0, 1, 2, 0,
+            1, 5, 0, 0, 0, 0, 1, 0, 1, 2, 0, 0, 1, 7, 1, 6,
+            4, 0, 0, 0, 0, 0, 0, 2, 2, 1, 0, 0, 1, 3, 2, 0,
+            7, 3, 1, 4, 0, 0, 0, 1, 0, 15, 0, 0, 1, 0, 1, 7};
+        const uint8_t NAME_SLOTS[256] = {
+            132, 0, 0, 0, 89, 64, 62, 145, 94, 55, 0, 119, 80, 120, 0, 99,
+            22, 0, 0, 0, 85, 0, 30, 72, 0, 57, 140, 101, 0, 27, 43, 0,
+            116, 0, 35, 0, 129, 0, 5, 0, 0, 32, 36, 138, 0, 0, 83, 91,
+            0, 0, 0, 0, 49, 0, 0, 12, 0, 0, 0, 53, 0, 0, 0, 47,
+            115, 0, 38, 98, 9, 0, 0, 126, 18, 125, 92, 8, 0, 130, 113, 3,
+            20, 61, 74, 21, 79, 0, 23, 0, 73, 6, 11, 0, 40, 0, 66, 0,
+            0, 118, 1, 15, 147, 0, 24, 59, 0, 60, 0, 0, 139, 0, 81, 0,
+            0, 90, 0, 106, 136, 121, 0, 134, 33, 148, 0, 51, 0, 0, 75, 0,
+            142, 0, 0, 13, 124, 46, 128, 48, 0, 103, 137, 0, 0, 0, 76, 0,
+            42, 0, 50, 0, 0, 4, 69, 17, 107, 0, 135, 7, 0, 0, 0, 0,
+            0, 96, 0, 65, 19, 0, 26, 0, 34, 0, 39, 112, 56, 100, 127, 77,
+            117, 123, 0, 54, 146, 0, 0, 25, 44, 70, 108, 0, 58, 105, 68, 0,
+            0, 0, 0, 0, 143, 41, 14, 133, 84, 0, 29, 0, 87, 0, 0, 0,
+            0, 114, 97, 104, 0, 0, 63, 52, 88, 0, 0, 0, 0, 2, 0, 28,
+            0, 0, 93, 31, 0, 141, 16, 0, 0, 0, 71, 0, 102, 110, 78, 111,
+            10, 144, 37, 82, 45, 122, 0, 86, 109, 95, 0, 0, 131, 67, 0, 0};
+
+        //! FNV-1a hash.
+        uint32_t hash(const char *str, size_t size)
+        {
+            uint32_t h = 2166136261u;
+            for (size_t i = 0; i < size; i++)
+            {
+                h = (h ^ (unsigned char)str[i]) * 16777619u;
+            }
+            return h;
+        }
+
+        //! Values of the hexadecimal digits, -1 for other characters.
+        struct HexDigits
+        {
+            int8_t values[256];
+
+            HexDigits()
+            {
+                std::memset(values, -1, sizeof(values));
+                for (int i = 0; i < 10; i++)
+                {
+                    values['0' + i] = i;
+                }
+                for (int i = 0; i < 6; i++)
+                {
+                    values['a' + i] = values['A' + i] = 10 + i;
+                }
+            }
+            int operator[](char c) const { return values[(unsigned char)c]; }
+        };
+        const HexDigits HEX_DIGITS;
+
+        Color unpack(uint32_t rgb)
+        {
+            return Color{(rgb_value)(rgb >> 16), (rgb_value)(rgb >> 8), (rgb_value)rgb};
+        }
+
+        [[noreturn]] void invalid(const char *str, size_t size)
+        {
+            throw std::invalid_argument("Invalid color: '" + std::string(str, size) + "'");
+        }
+
+        //! Parse the digits of '#rgb' and '#rrggbb' colors.
+        Color parse_hex(const char *str, size_t size)
+        {
+            int d[6];
+            int any_invalid = 0;
+            for (size_t i = 0; i < size; i++)
+            {
+                d[i] = HEX_DIGITS[str[i]];
+                any_invalid |= d[i];
+            }
+            if (any_invalid < 0)
+            {
+                invalid(str - 1, size + 1);
+            }
+            if (size == 3)
+            {
+                // Each digit is repeated: #abc is #aabbcc.
+                return Color{(rgb_value)(d[0] * 17), (rgb_value)(d[1] * 17), (rgb_value)(d[2] * 17)};
+            }
+            return Color{(rgb_value)(d[0] << 4 | d[1]), (rgb_value)(d[2] << 4 | d[3]), (rgb_value)(d[4] << 4 | d[5])};
+        }
+
+        //! Parse the components of 'rgb(r, g, b)' colors.
+        Color parse_rgb(const char *str, size_t size)
+        {
+            const char *s = str + 4;
+            const char *end = str + size - 1;
+            rgb_value components[3];
+            for (int i = 0; i < 3; i++)
+            {
+                skip_separator(s, end);
+                double value;
+                if (!parse_number(s, end, value))
+                {
+                    invalid(str, size);
+                }
+                if (s < end && *s == '%')
+                {
+                    value = value * 255 / 100;
+                    s++;
+                }
+                components[i] = (rgb_value)round_number(value < 0 ? 0 : value > 255 ? 255 : value);
+            }
+            skip_separator(s, end);
+            if (s != end)
+            {
+                invalid(str, size);
+            }
+            return Color{components[0], components[1], components[2]};
+        }
+
+        //! Look up a color name, in any case.
+        Color parse_name(const char *str, size_t size)
+        {
+            if (size == 0 || size > MAX_NAME_SIZE)
+            {
+                invalid(str, size);
+            }
+            char name[MAX_NAME_SIZE];
+            for (size_t i = 0; i < size; i++)
+            {
+                char c = str[i];
+                name[i] = c >= 'A' && c <= 'Z' ? c - 'A' + 'a' : c;
+            }
+            uint32_t h = hash(name, size);
+            uint32_t d = NAME_DISPLACEMENTS[h % 64];
+            uint8_t slot = NAME_SLOTS[((h >> 8) + d * ((h >> 16) | 1)) % 256];
+            if (slot == 0)
+            {
+                invalid(str, size);
+            }
+            const NamedColor &color = NAMED_COLORS[slot - 1];
+            if (std::strncmp(color.name, name, size) != 0 || color.name[size] != '\0')
+            {
+                invalid(str, size);
+            }
+            return unpack(color.rgb);
+        }
+    }
 
     Color parse_color(const std::string &str)
     {
-        Color c;
-        if (str.at(0) == '#')
+        return parse_color(str.data(), str.size());
+    }
+
+    Color parse_color(const char *str, size_t size)
+    {
+        while (size > 0 && (*str == ' ' || *str == '\t' || *str == '\n' || *str == '\r'))
+        {
+            str++;
+            size--;
+        }
+        while (size > 0 && (str[size - 1] == ' ' || str[size - 1] == '\t' || str[size - 1] == '\n' || str[size - 1] == '\r'))
+        {
+            size--;
+        }
+        if (size > 0 && str[0] == '#')
+        {
+            if (size != 4 && size != 7)
+            {
+                invalid(str, size);
+            }
+            return parse_hex(str + 1, size - 1);
+        }
+        if (size > 5 && std::strncmp(str, "rgb(", 4) == 0 && str[size - 1] == ')')
+        {
+            return parse_rgb(str, size);
+        }
+        return parse_name(str, size);
+    }
+
+    ColorCache::ColorCache()
+    {
+        for (Entry &entry : entries_)
+        {
+            entry.size = 0;
+        }
+    }
+
+    Color ColorCache::parse(const char *str, size_t size)
+    {
+        // Hexadecimal colors are decoded faster than they are looked up.
+        if (size == 0 || size > sizeof(Entry::text) || str[0] == '#')
         {
-            int v;
-            std::istringstream ss(str.substr(1));
-            ss >> std::hex >> v;
-            c.red = (v >> 16);
-            c.green = (v >> 8) & 0xFF;
-            c.blue = v & 0xFF;
+            return parse_color(str, size);
         }
-        else
+        Entry &entry = entries_[hash(str, size) % 256];
+        if (entry.size != size || std::memcmp(entry.text, str, size) != 0)
         {
-            c = NAMES_TO_COLORS.at(str);
+            // Parse before updating the entry, which stays unchanged if
+            // the string is not a color.
+            Color color = parse_color(str, size);
+            entry.size = (unsigned char)size;
+            std::memcpy(entry.text, str, size);
+            entry.color = color;
         }
-        return c;
+        return entry.color;
     }
-}
\ No newline at end of file
+}
@@ -2,6 +2,7 @@
 #ifndef __svg_Color_hpp__
 #define __svg_Color_hpp__
 
+#include <cstddef>
 #include <string>
 
 namespace svg {
@@ -18,12 +19,48 @@ namespace svg {
   };
 
   //! Parse a color from a string.
-  //! The string may refer to a color name or have a
-  //! '#rrggbb' format where 'rr', 'gg' and 'bb' 
-  //! are hexadecimal values for each RGB component. 
+  //! The string may refer to a CSS color name (in any case), have a
+  //! '#rrggbb' or '#rgb' format where 'rr', 'gg' and 'bb' (or 'r',
+  //! 'g' and 'b') are hexadecimal values for each RGB component, or
+  //! an 'rgb(r, g, b)' format with numbers or percentages.
   //! @param str String.
   //! @return A corresponding color.
+  //! @throws std::invalid_argument if the string is not a color.
   Color parse_color(const std::string& str);
-  
+
+  //! Parse a color from characters that need not be null-terminated,
+  //! as parse_color(const std::string&).
+  //! @param str First character.
+  //! @param size Number of characters.
+  //! @return A corresponding color.
+  Color parse_color(const char* str, size_t size);
+
+  //! Cache of parsed colors, for documents that repeat the same color
+  //! names or rgb() strings: each string is parsed once, and later
+  //! occurrences are found by their hash. The cache keeps the 256 most
+  //! recent short strings, one per hash slot; '#' colors are always
+  //! decoded, which is faster than a lookup.
+  class ColorCache {
+  public:
+    //! Constructor, creating an empty cache.
+    ColorCache();
+    //! Parse a color, as parse_color(const char*, size_t).
+    //! @param str First character.
+    //! @param size Number of characters.
+    //! @return A corresponding color.
+    Color parse(const char* str, size_t size);
+  private:
+    //! A parsed string.
+    struct Entry {
+      //! Number of characters, 0 for an empty slot.
+      unsigned char size;
+      //! Characters.
+      char text[15];
+      //! Color.
+      Color color;
+    };
+    //! Entries, indexed by the hash of their string.
+    Entry entries_[256];
+  };
 }
-#endif
\ No newline at end of file
+#endif
@@ -0,0 +1,269 @@
+//! @file CoverageRasterizer.cpp
+#include "CoverageRasterizer.hpp"
+
+#include <algorithm>
+#include <cmath>
+
+namespace svg
+{
+    namespace
+    {
+        //! Coverage below this is not drawn, and above 1 minus this is full.
+        const double COVERAGE_EPSILON = 1.0 / 512;
+
+        //! Coverage of a pixel given the winding sum at it.
+        double coverage_of(double winding, FillRule rule)
+        {
+            double w = std::fabs(winding);
+            if (rule == FillRule::EvenOdd)
+            {
+                w = std::fmod(w, 2.0);
+                if (w > 1.0)
+                {
+                    w = 2.0 - w;
+                }
+            }
+            return std::min(w, 1.0);
+        }
+    }
+
+    void CoverageRasterizer::add_span(std::vector<CoverageSpan> &spans,
+                                      int x0, int x1, double coverage) const
+    {
+        x0 = std::max(x0, clip_.min.x);
+        x1 = std::min(x1, clip_.max.x);
+        if (x0 < x1 && coverage > COVERAGE_EPSILON)
+        {
+            spans.push_back({x0, x1, (float)coverage});
+        }
+    }
+
+    CoverageRasterizer::CoverageRasterizer(int x_min, int x_max, const BBox &clip)
+        : left_(x_min), right_(x_max), clip_(clip), next_(0), sorted_(false),
+          y_min_(HUGE_VAL), y_max_(-HUGE_VAL)
+    {
+        // One extra cell on the right receives the area of pieces
+        // ending exactly at the right bound.
+        size_t cells = clip.empty() ? 0 : (size_t)(x_max - x_min) + 2;
+        acc_.assign(cells, 0.0);
+        touched_.assign(cells, 0);
+    }
+
+    void CoverageRasterizer::add_edge(double x0, double y0, double x1, double y1)
+    {
+        if (y0 == y1)
+        {
+            // Horizontal edges cover no area.
+            return;
+        }
+        Edge e;
+        e.dir = 1.0;
+        if (y0 > y1)
+        {
+            std::swap(x0, x1);
+            std::swap(y0, y1);
+            e.dir = -1.0;
+        }
+        e.x0 = x0;
+        e.y0 = y0;
+        e.x1 = x1;
+        e.y1 = y1;
+        e.dxdy = (x1 - x0) / (y1 - y0);
+        edges_.push_back(e);
+        y_min_ = std::min(y_min_, y0);
+        y_max_ = std::max(y_max_, y1);
+    }
+
+    int CoverageRasterizer::first_row() const
+    {
+        if (edges_.empty())
+        {
+            return clip_.min.y;
+        }
+        return std::max((int)std::floor(y_min_), clip_.min.y);
+    }
+
+    int CoverageRasterizer::end_row() const
+    {
+        if (edges_.empty() || clip_.empty())
+        {
+            return clip_.min.y;
+        }
+        return std::min((int)std::ceil(y_max_), clip_.max.y);
+    }
+
+    void CoverageRasterizer::add_cell(int x, double v)
+    {
+        int i = x - left_;
+        acc_[i] += v;
+        if (!touched_[i])
+        {
+            touched_[i] = 1;
+            cells_.push_back(x);
+        }
+    }
+
+    void CoverageRasterizer::add_piece(double xa, double xb, double d)
+    {
+        if (xa > xb)
+        {
+            std::swap(xa, xb);
+        }
+        const double left = left_, right = right_;
+        if (xa >= right)
+        {
+            // Only pixels to the right of the bounds are affected.
+            return;
+        }
+        if (xb <= left)
+        {
+            // Everything to the left of the bounds acts as
+            // a vertical edge on the left bound.
+            add_cell(left_, d);
+            return;
+        }
+        // The height of a part of the piece is proportional to its width.
+        double w = xb - xa;
+        if (xa < left)
+        {
+            double d_left = d * (left - xa) / w;
+            add_cell(left_, d_left);
+            d -= d_left;
+            w = xb - left;
+            xa = left;
+        }
+        if (xb > right)
+        {
+            d *= (right - xa) / w;
+            xb = right;
+        }
+        accumulate(xa, xb, d);
+    }
+
+    void CoverageRasterizer::accumulate(double x0, double x1, double d)
+    {
+        // The piece covers a trapezoid inside of the row. Each cell
+        // gets the part of d left of its right side that the piece
+        // does not cover, and the next cell the rest, so that the
+        // running sum of the cells gives the covered area.
+        double x0_floor = std::floor(x0);
+        int x0i = (int)x0_floor;
+        double x1_ceil = std::ceil(x1);
+        int x1i = (int)x1_ceil;
+        if (x1i <= x0i + 1)
+        {
+            // The piece stays inside of one cell.
+            double xm = 0.5 * (x0 + x1) - x0_floor;
+            add_cell(x0i, d - d * xm);
+            add_cell(x0i + 1, d * xm);
+            return;
+        }
+        double s = 1.0 / (x1 - x0);
+        double x0f = x0 - x0_floor;
+        double a0 = 0.5 * s * (1.0 - x0f) * (1.0 - x0f);
+        double x1f = x1 - x1_ceil + 1.0;
+        double am = 0.5 * s * x1f * x1f;
+        add_cell(x0i, d * a0);
+        if (x1i == x0i + 2)
+        {
+            add_cell(x0i + 1, d * (1.0 - a0 - am));
+        }
+        else
+        {
+            double a1 = s * (1.5 - x0f);
+            add_cell(x0i + 1, d * (a1 - a0));
+            for (int x = x0i + 2; x < x1i - 1; x++)
+            {
+                add_cell(x, d * s);
+            }
+            double a2 = a1 + (x1i - x0i - 3) * s;
+            add_cell(x1i - 1, d * (1.0 - a2 - am));
+        }
+        add_cell(x1i, d * am);
+    }
+
+    void CoverageRasterizer::sweep_row(int y, FillRule rule, std::vector<CoverageSpan> &spans)
+    {
+        spans.clear();
+        if (!sorted_)
+        {
+            std::sort(edges_.begin(), edges_.end(),
+                      [](const Edge &a, const Edge &b)
+                      { return a.y0 < b.y0; });
+            sorted_ = true;
+        }
+        const double top = y, bottom = y + 1.0;
+        // Retire finished edges and activate the ones reaching this row.
+        size_t n = 0;
+        for (size_t i = 0; i < active_.size(); i++)
+        {
+            if (active_[i].y1 > top)
+            {
+                active_[n++] = active_[i];
+            }
+        }
+        active_.resize(n);
+        for (; next_ < edges_.size() && edges_[next_].y0 < bottom; next_++)
+        {
+            if (edges_[next_].y1 > top)
+            {
+                active_.push_back(edges_[next_]);
+            }
+        }
+        if (acc_.empty())
+        {
+            return;
+        }
+        for (const Edge &e : active_)
+        {
+            double ya = std::max(top, e.y0);
+            double yb = std::min(bottom, e.y1);
+            if (yb <= ya)
+            {
+                continue;
+            }
+            double xa = e.x0 + (ya - e.y0) * e.dxdy;
+            double xb = e.x0 + (yb - e.y0) * e.dxdy;
+            add_piece(xa, xb, (yb - ya) * e.dir);
+        }
+
+        // Running sum over the touched cells; between two of them
+        // the coverage does not change. The sum starts at the left
+        // bound whatever the clip region is, so that it adds the
+        // same values in the same order.
+        std::sort(cells_.begin(), cells_.end());
+        double winding = 0.0;
+        int run_start = left_;
+        for (int x : cells_)
+        {
+            add_span(spans, run_start, x, coverage_of(winding, rule));
+            int i = x - left_;
+            winding += acc_[i];
+            acc_[i] = 0.0;
+            touched_[i] = 0;
+            add_span(spans, x, x + 1, coverage_of(winding, rule));
+            run_start = x + 1;
+        }
+        cells_.clear();
+        add_span(spans, run_start, right_, coverage_of(winding, rule));
+        // Merge neighbouring cells of full coverage into single spans.
+        n = 0;
+        for (size_t i = 0; i < spans.size(); i++)
+        {
+            if (spans[i].coverage > 1.0 - COVERAGE_EPSILON)
+            {
+                spans[i].coverage = 1.0f;
+            }
+            if (n > 0 && spans[n - 1].x1 == spans[i].x0 &&
+                spans[n - 1].coverage == 1.0f && spans[i].coverage == 1.0f)
+            {
+                spans[n - 1].x1 = spans[i].x1;
+            }
+            else
+            {
+                spans[n++] = spans[i];
+            }
+        }
+        spans.resize(n);
+    }
+}
@@ -0,0 +1,124 @@
+//! @file CoverageRasterizer.hpp
+#ifndef __svg_CoverageRasterizer_hpp__
+#define __svg_CoverageRasterizer_hpp__
+
+#include "Point.hpp"
+#include "PNGImage.hpp"
+
+#include <vector>
+
+namespace svg
+{
+    //! Run of pixels of a row with the same coverage.
+    struct CoverageSpan
+    {
+        //! First X position of the run.
+        int x0;
+        //! X position one past the end of the run.
+        int x1;
+        //! Fraction of the area of each pixel covered by the shape, in ]0, 1].
+        float coverage;
+    };
+
+    //! Anti-aliasing rasterizer computing the exact area of each pixel
+    //! covered by a shape made of straight edges.
+    //! Coordinates are continuous, with pixel (x, y) covering the square
+    //! [x, x + 1[ x [y, y + 1[. Each row is swept once: every edge adds
+    //! its signed area to the cells it crosses, and a running sum over
+    //! the cells gives the coverage. Only cells crossed by edges are
+    //! visited, and the runs between them are reported as spans.
+    class CoverageRasterizer
+    {
+    public:
+        //! Constructor.
+        //! Coverage only depends on the shape and on the horizontal
+        //! bounds (edges beyond them are folded onto them), so shapes
+        //! drawn in parts with different clip regions get the same
+        //! coverage for each pixel.
+        //! @param x_min Left bound of the rows, usually 0.
+        //! @param x_max Right bound of the rows, usually the image width.
+        //! @param clip Region of pixels to compute the coverage for,
+        //! between the left and right bounds.
+        CoverageRasterizer(int x_min, int x_max, const BBox &clip);
+        //! Add an edge of the shape.
+        //! Edges must form closed outlines, in any direction.
+        //! @param x0 X coordinate of the edge start.
+        //! @param y0 Y coordinate of the edge start.
+        //! @param x1 X coordinate of the edge end.
+        //! @param y1 Y coordinate of the edge end.
+        void add_edge(double x0, double y0, double x1, double y1);
+        //! Get the first row that may be covered.
+        //! @return The row.
+        int first_row() const;
+        //! Get the row after the last one that may be covered.
+        //! @return The row.
+        int end_row() const;
+        //! Compute the covered runs of a row.
+        //! Rows must be swept in increasing order.
+        //! @param y Row to sweep.
+        //! @param rule Fill rule for overlapping outlines.
+        //! @param spans Vector receiving the runs, from left to right.
+        void sweep_row(int y, FillRule rule, std::vector<CoverageSpan> &spans);
+
+    private:
+        //! Edge, stored from top to bottom.
+        struct Edge
+        {
+            //! Top end.
+            double x0, y0;
+            //! Bottom end.
+            double x1, y1;
+            //! X increment per unit of Y.
+            double dxdy;
+            //! +1 for edges going down, -1 for edges going up.
+            double dir;
+        };
+
+        //! Add the area of an edge piece within the current row.
+        //! @param xa X coordinate of one end of the piece.
+        //! @param xb X coordinate of the other end of the piece.
+        //! @param d Signed height of the piece.
+        void add_piece(double xa, double xb, double d);
+        //! Add the area of an edge piece lying between the row bounds.
+        //! @param x0 Lowest X coordinate of the piece.
+        //! @param x1 Highest X coordinate of the piece.
+        //! @param d Signed height of the piece.
+        void accumulate(double x0, double x1, double d);
+        //! Add a run of pixels to the spans of a row, clipped to the clip region.
+        //! @param spans Spans of the row.
+        //! @param x0 First X position of the run.
+        //! @param x1 X position one past the end of the run.
+        //! @param coverage Coverage of the run.
+        void add_span(std::vector<CoverageSpan> &spans, int x0, int x1, double coverage) const;
+        //! Add to the accumulator of a cell.
+        //! @param x Cell X position.
+        //! @param v Value to add.
+        void add_cell(int x, double v);
+
+        //! Left bound of the rows.
+        int left_;
+        //! Right bound of the rows.
+        int right_;
+        //! Region of pixels to compute the coverage for.
+        BBox clip_;
+        //! Edges, sorted by top Y when sweeping starts.
+        std::vector<Edge> edges_;
+        //! Edges crossing the current row.
+        std::vector<Edge> active_;
+        //! Index of the next edge to activate.
+        size_t next_;
+        //! Whether the edges have been sorted.
+        bool sorted_;
+        //! Lowest Y coordinate of the edges.
+        double y_min_;
+        //! Highest Y coordinate of the edges.
+        double y_max_;
+        //! Area accumulators of the cells of the row, from left_.
+        std::vector<double> acc_;
+        //! Whether each cell was touched in the current row.
+        std::vector<char> touched_;
+        //! Cells touched in the current row.
+        std::vector<int> cells_;
+    };
+}
+#endif
@@ -0,0 +1,674 @@
+//! @file Deflate.cpp
+#include <algorithm>
+#include <functional>
+#include <queue>
+#include <utility>
+#include "Deflate.hpp"
+
+namespace svg
+{
+    namespace
+    {
+        //! Largest distance of a match.
+        const size_t WINDOW_SIZE = 32768;
+        const size_t MIN_MATCH = 3;
+        const size_t MAX_MATCH = 258;
+        //! Matches of MIN_MATCH bytes farther than this cost more than
+        //! their literals.
+        const size_t TOO_FAR = 4096;
+        const int HASH_BITS = 15;
+        //! Largest number of symbols of a block.
+        const size_t BLOCK_SYMBOLS = 16384;
+        //! Largest number of bytes of a stored block.
+        const size_t MAX_STORED = 65535;
+        const int LITERAL_CODES = 286;
+        const int DISTANCE_CODES = 30;
+        const int END_OF_BLOCK = 256;
+
+        //! Search parameters of a compression level, as zlib's.
+        struct LevelConfig
+        {
+            //! Length of a match after which the next position is only
+            //! searched with a quarter of the chain.
+            size_t good;
+            //! Longest match for which the next position is searched for
+            //! a longer one, 0 to take matches as soon as they are found.
+            size_t lazy;
+            //! Length of a match after which searching stops.
+            size_t nice;
+            //! Largest number of earlier strings compared.
+            size_t chain;
+            //! Longest match whose positions are all added to the hash
+            //! chains, rather than only its first one.
+            size_t insert;
+        };
+        const LevelConfig LEVELS[10] = {{0, 0, 0, 0, 0},
+                                        {4, 0, 8, 4, 4},
+                                        {4, 0, 16, 8, 5},
+                                        {4, 0, 32, 32, 6},
+                                        {4, 4, 16, 16, 258},
+                                        {8, 16, 32, 32, 258},
+                                        {8, 16, 128, 128, 258},
+                                        {8, 32, 128, 256, 258},
+                                        {32, 128, 258, 1024, 258},
+                                        {32, 258, 258, 4096, 258}};
+
+        const uint16_t LENGTH_BASE[29] = {3, 4, 5, 6, 7, 8, 9, 10, 11, 13, 15, 17, 19, 23, 27, 31,
+                                          35, 43, 51, 59, 67, 83, 99, 115, 131, 163, 195, 227, 258};
+        const uint8_t LENGTH_EXTRA[29] = {0, 0, 0, 0, 0, 0, 0, 0, 1, 1, 1, 1, 2, 2, 2, 2,
+                                          3, 3, 3, 3, 4, 4, 4, 4, 5, 5, 5, 5, 0};
+        const uint16_t DISTANCE_BASE[30] = {1, 2, 3, 4, 5, 7, 9, 13, 17, 25, 33, 49, 65, 97, 129,
+                                            193, 257, 385, 513, 769, 1025, 1537, 2049, 3073, 4097,
+                                            6145, 8193, 12289, 16385, 24577};
+        const uint8_t DISTANCE_EXTRA[30] = {0, 0, 0, 0, 1, 1, 2, 2, 3, 3, 4, 4, 5, 5, 6,
+                                            6, 7, 7, 8, 8, 9, 9, 10, 10, 11, 11, 12, 12, 13, 13};
+        //! Order of the code lengths of the code length alphabet.
+        const uint8_t CODE_LENGTH_ORDER[19] = {16, 17, 18, 0, 8, 7, 9, 6, 10, 5, 11, 4, 12, 3, 13, 2, 14, 1, 15};
+
+        //! Codes of match lengths and distances, computed once.
+        struct CodeTables
+        {
+            //! Length code (minus 257) of each match length.
+            uint8_t length_code[MAX_MATCH + 1];
+            //! Distance code of distances 1 to 256 (at distance - 1),
+            //! then of larger distances (at 256 + (distance - 1) / 128).
+            uint8_t distance_code[512];
+
+            CodeTables()
+            {
+                for (int code = 0; code < 29; code++)
+                {
+                    for (int n = 0; n < (1 << LENGTH_EXTRA[code]); n++)
+                    {
+                        length_code[LENGTH_BASE[code] + n] = code;
+                    }
+                }
+                // 258 has a code of its own, rather than 227 + 31.
+                length_code[MAX_MATCH] = 28;
+                for (int code = 0; code < 30; code++)
+                {
+                    for (int n = 0; n < (1 << DISTANCE_EXTRA[code]); n++)
+                    {
+                        size_t d = DISTANCE_BASE[code] + n - 1;
+                        distance_code[d < 256 ? d : 256 + (d >> 7)] = code;
+                    }
+                }
+            }
+            int distance(size_t d) const
+            {
+                d--;
+                return distance_code[d < 256 ? d : 256 + (d >> 7)];
+            }
+        };
+        const CodeTables &code_tables()
+        {
+            static const CodeTables tables;
+            return tables;
+        }
+
+        //! CRC-32 of each byte value, computed once.
+        struct CrcTable
+        {
+            uint32_t values[256];
+
+            CrcTable()
+            {
+                for (uint32_t n = 0; n < 256; n++)
+                {
+                    uint32_t c = n;
+                    for (int k = 0; k < 8; k++)
+                    {
+                        c = c & 1 ? 0xEDB88320u ^ (c >> 1) : c >> 1;
+                    }
+                    values[n] = c;
+                }
+            }
+        };
+
+        //! Compute the lengths of a Huffman code limited to a number of
+        //! bits. Frequencies are halved until the code fits, which is
+        //! rarely needed and costs little.
+        //! At least two symbols get a code, as decoders require.
+        //! @param freq Frequency of each symbol.
+        //! @param n Number of symbols.
+        //! @param limit Longest code.
+        //! @param lengths Set to the length of each symbol, 0 if unused.
+        void huffman_lengths(const uint32_t *freq, int n, int limit, uint8_t *lengths)
+        {
+            std::vector<uint64_t> weights(freq, freq + n);
+            int used = (int)std::count_if(weights.begin(), weights.end(), [](uint64_t f) { return f != 0; });
+            for (int i = 0; i < n && used < 2; i++)
+            {
+                if (weights[i] == 0)
+                {
+                    weights[i] = 1;
+                    used++;
+                }
+            }
+            while (true)
+            {
+                typedef std::pair<uint64_t, int> Node;
+                std::priority_queue<Node, std::vector<Node>, std::greater<Node>> queue;
+                // Leaves are 0 to n - 1, inner nodes follow.
+                std::vector<int> parent(n, -1);
+                for (int i = 0; i < n; i++)
+                {
+                    if (weights[i] != 0)
+                    {
+                        queue.push(Node(weights[i], i));
+                    }
+                }
+                while (queue.size() > 1)
+                {
+                    Node a = queue.top();
+                    queue.pop();
+                    Node b = queue.top();
+                    queue.pop();
+                    int node = (int)parent.size();
+                    parent.push_back(-1);
+                    parent[a.second] = parent[b.second] = node;
+                    queue.push(Node(a.first + b.first, node));
+                }
+                // Parents come after their children, so depths are found
+                // from the root down.
+                std::vector<int> depth(parent.size(), 0);
+                for (int i = (int)parent.size() - 2; i >= 0; i--)
+                {
+                    depth[i] = parent[i] < 0 ? 0 : depth[parent[i]] + 1;
+                }
+                bool fits = true;
+                for (int i = 0; i < n; i++)
+                {
+                    lengths[i] = weights[i] != 0 ? depth[i] : 0;
+                    fits = fits && depth[i] <= limit;
+                }
+                if (fits)
+                {
+                    return;
+                }
+                for (uint64_t &w : weights)
+                {
+                    w = w != 0 ? (w + 1) / 2 : 0;
+                }
+            }
+        }
+
+        //! Compute the canonical codes of a Huffman code, bit-reversed
+        //! since deflate writes them most significant bit first.
+        //! @param lengths Length of each symbol.
+        //! @param n Number of symbols.
+        //! @param codes Set to the code of each symbol.
+        void huffman_codes(const uint8_t *lengths, int n, uint16_t *codes)
+        {
+            int count[16] = {0};
+            for (int i = 0; i < n; i++)
+            {
+                count[lengths[i]]++;
+            }
+            count[0] = 0;
+            int next[16] = {0};
+            for (int bits = 1, code = 0; bits < 16; bits++)
+            {
+                code = (code + count[bits - 1]) << 1;
+                next[bits] = code;
+            }
+            for (int i = 0; i < n; i++)
+            {
+                int code = next[lengths[i]]++;
+                int reversed = 0;
+                for (int b = 0; b < lengths[i]; b++)
+                {
+                    reversed = (reversed << 1) | ((code >> b) & 1);
+                }
+                codes[i] = (uint16_t)reversed;
+            }
+        }
+
+        //! Lengths of the fixed Huffman codes.
+        void fixed_lengths(uint8_t *literals, uint8_t *distances)
+        {
+            for (int i = 0; i < 288; i++)
+            {
+                literals[i] = i < 144 ? 8 : i < 256 ? 9 : i < 280 ? 7 : 8;
+            }
+            std::fill(distances, distances + DISTANCE_CODES, 5);
+        }
+
+        uint32_t hash(const unsigned char *s)
+        {
+            uint32_t v = s[0] | (uint32_t)s[1] << 8 | (uint32_t)s[2] << 16;
+            return (v * 2654435761u) >> (32 - HASH_BITS);
+        }
+    }
+
+    uint32_t adler32(uint32_t adler, const unsigned char *data, size_t size)
+    {
+        const uint32_t BASE = 65521;
+        // Largest number of bytes before the sums may overflow.
+        const size_t NMAX = 5552;
+        uint32_t a = adler & 0xFFFF, b = adler >> 16;
+        while (size > 0)
+        {
+            size_t n = std::min(size, NMAX);
+            size -= n;
+            for (; n > 0; n--)
+            {
+                a += *data++;
+                b += a;
+            }
+            a %= BASE;
+            b %= BASE;
+        }
+        return a | b << 16;
+    }
+
+    uint32_t adler32_combine(uint32_t adler1, uint32_t adler2, size_t size2)
+    {
+        const uint64_t BASE = 65521;
+        uint64_t rem = size2 % BASE;
+        uint64_t a1 = adler1 & 0xFFFF, b1 = adler1 >> 16;
+        uint64_t a2 = adler2 & 0xFFFF, b2 = adler2 >> 16;
+        uint64_t a = (a1 + a2 + BASE - 1) % BASE;
+        uint64_t b = (rem * a1 + b1 + b2 + BASE - rem) % BASE;
+        return (uint32_t)(a | b << 16);
+    }
+
+    uint32_t crc32(uint32_t crc, const unsigned char *data, size_t size)
+    {
+        static const CrcTable table;
+        crc = ~crc;
+        for (size_t i = 0; i < size; i++)
+        {
+            crc = table.values[(crc ^ data[i]) & 0xFF] ^ (crc >> 8);
+        }
+        return ~crc;
+    }
+
+    uint16_t zlib_header(int level)
+    {
+        // Deflate with a 32 KiB window, and the level in the check bits.
+        return level <= 1 ? 0x7801 : level <= 5 ? 0x785E : level == 6 ? 0x789C : 0x78DA;
+    }
+
+    struct Deflater::BitWriter
+    {
+        std::vector<unsigned char> &out;
+        uint64_t bits;
+        int count;
+
+        //! Write the low n bits of a value.
+        void put(uint32_t value, int n)
+        {
+            bits |= (uint64_t)value << count;
+            count += n;
+            if (count >= 32)
+            {
+                for (int i = 0; i < 4; i++)
+                {
+                    out.push_back((unsigned char)(bits >> (8 * i)));
+                }
+                bits >>= 32;
+                count -= 32;
+            }
+        }
+        //! Pad with zero bits to a byte boundary.
+        void align()
+        {
+            for (; count > 0; count -= 8)
+            {
+                out.push_back((unsigned char)bits);
+                bits >>= 8;
+            }
+            bits = 0;
+            count = 0;
+        }
+    };
+
+    Deflater::Deflater(int level)
+        : level_(std::min(std::max(level, 0), 9)), base_(nullptr), end_(0),
+          head_((size_t)1 << HASH_BITS), prev_(WINDOW_SIZE)
+    {
+        symbols_.reserve(BLOCK_SYMBOLS);
+    }
+
+    void Deflater::insert(size_t pos)
+    {
+        uint32_t h = hash(base_ + pos);
+        prev_[pos & (WINDOW_SIZE - 1)] = head_[h];
+        head_[h] = pos + 1;
+    }
+
+    size_t Deflater::find_match(size_t pos, size_t chain, size_t &distance)
+    {
+        if (end_ - pos < MIN_MATCH)
+        {
+            return 0;
+        }
+        const LevelConfig &config = LEVELS[level_];
+        const unsigned char *s = base_ + pos;
+        size_t max_length = std::min(MAX_MATCH, end_ - pos);
+        size_t best = MIN_MATCH - 1;
+        size_t candidate = head_[hash(s)];
+        for (; candidate != 0 && chain > 0; chain--)
+        {
+            size_t c = candidate - 1;
+            if (pos - c > WINDOW_SIZE)
+            {
+                break;
+            }
+            const unsigned char *t = base_ + c;
+            if (t[best] == s[best] && t[0] == s[0] && t[1] == s[1])
+            {
+                size_t n = 2;
+                while (n < max_length && t[n] == s[n])
+                {
+                    n++;
+                }
+                if (n > best)
+                {
+                    best = n;
+                    distance = pos - c;
+                    if (n >= config.nice || n == max_length)
+                    {
+                        break;
+                    }
+                }
+            }
+            // Entries of positions out of the window may have been
+            // replaced; chains only go back.
+            size_t next = prev_[c & (WINDOW_SIZE - 1)];
+            if (next >= candidate)
+            {
+                break;
+            }
+            candidate = next;
+        }
+        insert(pos);
+        if (best < MIN_MATCH || (best == MIN_MATCH && distance > TOO_FAR))
+        {
+            return 0;
+        }
+        return best;
+    }
+
+    void Deflater::compress(const unsigned char *data, size_t size, size_t history, bool last,
+                            std::vector<unsigned char> &out)
+    {
+        BitWriter bits = {out, 0, 0};
+        symbols_.clear();
+        if (level_ == 0)
+        {
+            write_block(bits, data, size, last);
+        }
+        else
+        {
+            history = std::min(history, WINDOW_SIZE);
+            base_ = data - history;
+            end_ = history + size;
+            std::fill(head_.begin(), head_.end(), 0);
+            for (size_t pos = 0; pos + MIN_MATCH <= end_ && pos < history; pos++)
+            {
+                insert(pos);
+            }
+            const LevelConfig &config = LEVELS[level_];
+            size_t block_start = history;
+            size_t pos = history;
+            size_t length = 0, distance = 0;
+            // Whether the match at pos was found while looking ahead.
+            bool found = false;
+            while (pos < end_)
+            {
+                if (!found)
+                {
+                    length = find_match(pos, config.chain, distance);
+                }
+                found = false;
+                if (length != 0 && length < config.lazy && pos + 1 < end_)
+                {
+                    // A longer match at the next position is better than
+                    // this one.
+                    size_t next_distance = 0;
+                    size_t chain = length >= config.good ? config.chain / 4 : config.chain;
+                    size_t next_length = find_match(pos + 1, chain, next_distance);
+                    if (next_length > length)
+                    {
+                        symbols_.push_back(Symbol{base_[pos], 0});
+                        pos++;
+                        length = next_length;
+                        distance = next_distance;
+                        found = true;
+                    }
+                    else
+                    {
+                        symbols_.push_back(Symbol{(uint16_t)(256 + length), (uint16_t)distance});
+                        for (size_t i = pos + 2; i < pos + length && i + MIN_MATCH <= end_; i++)
+                        {
+                            insert(i);
+                        }
+                        pos += length;
+                    }
+                }
+                else if (length != 0)
+                {
+                    symbols_.push_back(Symbol{(uint16_t)(256 + length), (uint16_t)distance});
+                    for (size_t i = pos + 1; length <= config.insert && i < pos + length && i + MIN_MATCH <= end_; i++)
+                    {
+                        insert(i);
+                    }
+                    pos += length;
+                }
+                else
+                {
+                    symbols_.push_back(Symbol{base_[pos], 0});
+                    pos++;
+                }
+                if (symbols_.size() >= BLOCK_SYMBOLS)
+                {
+                    write_block(bits, base_ + block_start, pos - block_start, false);
+                    symbols_.clear();
+                    block_start = pos;
+                }
+            }
+            // The last block of the stream is written even if it is empty.
+            if (!symbols_.empty() || last)
+            {
+                write_block(bits, base_ + block_start, end_ - block_start, last);
+            }
+        }
+        if (!last)
+        {
+            // Empty stored block, ending the piece on a byte boundary.
+            bits.put(0, 3);
+            bits.align();
+            const unsigned char marker[4] = {0x00, 0x00, 0xFF, 0xFF};
+            out.insert(out.end(), marker, marker + 4);
+        }
+        else
+        {
+            bits.align();
+        }
+    }
+
+    void Deflater::write_block(BitWriter &bits, const unsigned char *data, size_t size, bool final)
+    {
+        const CodeTables &tables = code_tables();
+        uint32_t literal_freq[LITERAL_CODES] = {0};
+        uint32_t distance_freq[DISTANCE_CODES] = {0};
+        // Extra bits of the lengths and distances, the same for any code.
+        uint64_t extra_bits = 0;
+        for (const Symbol &symbol : symbols_)
+        {
+            if (symbol.distance == 0)
+            {
+                literal_freq[symbol.value]++;
+            }
+            else
+            {
+                int length_code = tables.length_code[symbol.value - 256];
+                int distance_code = tables.distance(symbol.distance);
+                literal_freq[257 + length_code]++;
+                distance_freq[distance_code]++;
+                extra_bits += LENGTH_EXTRA[length_code] + DISTANCE_EXTRA[distance_code];
+            }
+        }
+        literal_freq[END_OF_BLOCK] = 1;
+
+        uint8_t literal_lengths[288] = {0};
+        uint8_t distance_lengths[DISTANCE_CODES];
+        huffman_lengths(literal_freq, LITERAL_CODES, 15, literal_lengths);
+        huffman_lengths(distance_freq, DISTANCE_CODES, 15, distance_lengths);
+        int literal_count = LITERAL_CODES;
+        while (literal_count > 257 && literal_lengths[literal_count - 1] == 0)
+        {
+            literal_count--;
+        }
+        int distance_count = DISTANCE_CODES;
+        while (distance_count > 1 && distance_lengths[distance_count - 1] == 0)
+        {
+            distance_count--;
+        }
+        // Code lengths of both codes, run-length encoded with symbols
+        // 16 (repeat the last length), 17 and 18 (repeat zero).
+        std::vector<uint8_t> all_lengths(literal_lengths, literal_lengths + literal_count);
+        all_lengths.insert(all_lengths.end(), distance_lengths, distance_lengths + distance_count);
+        std::vector<std::pair<uint8_t, uint8_t>> runs;
+        uint32_t code_length_freq[19] = {0};
+        for (size_t i = 0; i < all_lengths.size();)
+        {
+            uint8_t value = all_lengths[i];
+            size_t run = 1;
+            while (i + run < all_lengths.size() && all_lengths[i + run] == value)
+            {
+                run++;
+            }
+            i += run;
+            if (value == 0)
+            {
+                for (; run >= 11; run -= std::min(run, (size_t)138))
+                {
+                    runs.push_back({18, (uint8_t)(std::min(run, (size_t)138) - 11)});
+                }
+                if (run >= 3)
+                {
+                    runs.push_back({17, (uint8_t)(run - 3)});
+                    run = 0;
+                }
+            }
+            else
+            {
+                runs.push_back({value, 0});
+                run--;
+                for (; run >= 3; run -= std::min(run, (size_t)6))
+                {
+                    runs.push_back({16, (uint8_t)(std::min(run, (size_t)6) - 3)});
+                }
+            }
+            for (; run > 0; run--)
+            {
+                runs.push_back({value, 0});
+            }
+        }
+        for (const auto &run : runs)
+        {
+            code_length_freq[run.first]++;
+        }
+        uint8_t code_length_lengths[19];
+        huffman_lengths(code_length_freq, 19, 7, code_length_lengths);
+        int code_length_count = 19;
+        while (code_length_count > 4 && code_length_lengths[CODE_LENGTH_ORDER[code_length_count - 1]] == 0)
+        {
+            code_length_count--;
+        }
+
+        // Sizes of the block with each kind of code, in bits.
+        uint8_t fixed_literal_lengths[288];
+        uint8_t fixed_distance_lengths[DISTANCE_CODES];
+        fixed_lengths(fixed_literal_lengths, fixed_distance_lengths);
+        uint64_t dynamic_size = 3 + 5 + 5 + 4 + 3 * code_length_count + extra_bits;
+        uint64_t fixed_size = 3 + extra_bits;
+        for (const auto &run : runs)
+        {
+            dynamic_size += code_length_lengths[run.first] + (run.first == 16 ? 2 : run.first == 17 ? 3 : run.first == 18 ? 7 : 0);
+        }
+        for (int i = 0; i < LITERAL_CODES; i++)
+        {
+            dynamic_size += (uint64_t)literal_freq[i] * literal_lengths[i];
+            fixed_size += (uint64_t)literal_freq[i] * fixed_literal_lengths[i];
+        }
+        for (int i = 0; i < DISTANCE_CODES; i++)
+        {
+            dynamic_size += (uint64_t)distance_freq[i] * distance_lengths[i];
+            fixed_size += (uint64_t)distance_freq[i] * fixed_distance_lengths[i];
+        }
+        uint64_t stored_size = (size + 5 * ((size + MAX_STORED - 1) / MAX_STORED)) * 8 + 7;
+
+        if (size > 0 && (level_ == 0 || stored_size < std::min(dynamic_size, fixed_size)))
+        {
+            for (size_t offset = 0; offset < size; offset += MAX_STORED)
+            {
+                size_t n = std::min(size - offset, MAX_STORED);
+                bits.put(final && offset + n == size, 1);
+                bits.put(0, 2);
+                bits.align();
+                const unsigned char header[4] = {(unsigned char)n, (unsigned char)(n >> 8),
+                                                 (unsigned char)~n, (unsigned char)(~n >> 8)};
+                bits.out.insert(bits.out.end(), header, header + 4);
+                bits.out.insert(bits.out.end(), data + offset, data + offset + n);
+            }
+            return;
+        }
+
+        const uint8_t *lengths = literal_lengths;
+        const uint8_t *dist_lengths = distance_lengths;
+        bits.put(final, 1);
+        if (fixed_size <= dynamic_size)
+        {
+            bits.put(1, 2);
+            lengths = fixed_literal_lengths;
+            dist_lengths = fixed_distance_lengths;
+        }
+        else
+        {
+            uint16_t code_length_codes[19];
+            huffman_codes(code_length_lengths, 19, code_length_codes);
+            bits.put(2, 2);
+            bits.put(literal_count - 257, 5);
+            bits.put(distance_count - 1, 5);
+            bits.put(code_length_count - 4, 4);
+            for (int i = 0; i < code_length_count; i++)
+            {
+                bits.put(code_length_lengths[CODE_LENGTH_ORDER[i]], 3);
+            }
+            for (const auto &run : runs)
+            {
+                bits.put(code_length_codes[run.first], code_length_lengths[run.first]);
+                if (run.first >= 16)
+                {
+                    bits.put(run.second, run.first == 16 ? 2 : run.first == 17 ? 3 : 7);
+                }
+            }
+        }
+        uint16_t literal_codes[288];
+        uint16_t distance_codes[DISTANCE_CODES];
+        huffman_codes(lengths, 288, literal_codes);
+        huffman_codes(dist_lengths, DISTANCE_CODES, distance_codes);
+        for (const Symbol &symbol : symbols_)
+        {
+            if (symbol.distance == 0)
+            {
+                bits.put(literal_codes[symbol.value], lengths[symbol.value]);
+            }
+            else
+            {
+                size_t length = symbol.value - 256;
+                int length_code = tables.length_code[length];
+                bits.put(literal_codes[257 + length_code], lengths[257 + length_code]);
+                bits.put((uint32_t)(length - LENGTH_BASE[length_code]), LENGTH_EXTRA[length_code]);
+                int distance_code = tables.distance(symbol.distance);
+                bits.put(distance_codes[distance_code], dist_lengths[distance_code]);
+                bits.put(symbol.distance - DISTANCE_BASE[distance_code], DISTANCE_EXTRA[distance_code]);
+            }
+        }
+        bits.put(literal_codes[END_OF_BLOCK], lengths[END_OF_BLOCK]);
+    }
+}
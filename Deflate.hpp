@@ -0,0 +1,107 @@
+//! @file Deflate.hpp
+#ifndef __svg_Deflate_hpp__
+#define __svg_Deflate_hpp__
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+namespace svg
+{
+    //! Update an Adler-32 checksum, the checksum of zlib streams.
+    //! @param adler Checksum of the previous bytes, 1 for none.
+    //! @param data First byte.
+    //! @param size Number of bytes.
+    //! @return Checksum.
+    uint32_t adler32(uint32_t adler, const unsigned char *data, size_t size);
+
+    //! Get the Adler-32 checksum of two pieces of data from the checksum
+    //! of each piece, as zlib's adler32_combine.
+    //! @param adler1 Checksum of the first piece.
+    //! @param adler2 Checksum of the second piece.
+    //! @param size2 Number of bytes of the second piece.
+    //! @return Checksum of both pieces, one after the other.
+    uint32_t adler32_combine(uint32_t adler1, uint32_t adler2, size_t size2);
+
+    //! Update a CRC-32, the checksum of PNG chunks.
+    //! @param crc Checksum of the previous bytes, 0 for none.
+    //! @param data First byte.
+    //! @param size Number of bytes.
+    //! @return Checksum.
+    uint32_t crc32(uint32_t crc, const unsigned char *data, size_t size);
+
+    //! Compressor of raw deflate data (RFC 1951).
+    //! Repeated strings are found with hash chains, whose length depends
+    //! on the compression level, and each block is written with dynamic
+    //! or fixed Huffman codes, or stored, whichever is smallest.
+    //! Pieces of data compressed separately (such as by several threads)
+    //! can be joined into one stream: each piece but the last one ends
+    //! with an empty stored block, on a byte boundary, and may refer to
+    //! the data before it, as pigz does.
+    class Deflater
+    {
+    public:
+        //! Constructor.
+        //! @param level Compression level, from 0 (stored) to 9 (smallest).
+        explicit Deflater(int level);
+        //! Compress data, appending it to a stream.
+        //! @param data First byte.
+        //! @param size Number of bytes.
+        //! @param history Number of bytes before data, which belong to the
+        //! previous pieces of the stream and may be referred to (only the
+        //! last 32 KiB are).
+        //! @param last Whether the data ends the stream.
+        //! @param out Stream to append to.
+        void compress(const unsigned char *data, size_t size, size_t history, bool last,
+                      std::vector<unsigned char> &out);
+
+    private:
+        //! Literal or match found in the data.
+        struct Symbol
+        {
+            //! Literal byte (0-255) or match length (3-258, plus 256).
+            uint16_t value;
+            //! Match distance, 0 for a literal.
+            uint16_t distance;
+        };
+        //! Writer of bits, least significant first.
+        struct BitWriter;
+        //! Add a position to the hash chains.
+        //! @param pos Position, with at least 3 bytes from it.
+        void insert(size_t pos);
+        //! Find the longest earlier string matching the bytes at a
+        //! position, and add the position to the hash chains.
+        //! @param pos Position.
+        //! @param chain Largest number of earlier strings to compare.
+        //! @param distance Set to the distance of the match.
+        //! @return Length of the match, 0 if there is none.
+        size_t find_match(size_t pos, size_t chain, size_t &distance);
+        //! Write the symbols found so far as a block.
+        //! @param bits Writer.
+        //! @param data First byte of the block.
+        //! @param size Number of bytes of the block.
+        //! @param final Whether the block ends the stream.
+        void write_block(BitWriter &bits, const unsigned char *data, size_t size, bool final);
+        //! Compression level.
+        int level_;
+        //! Data being compressed, from the start of its history;
+        //! positions are offsets from it.
+        const unsigned char *base_;
+        //! End position of the data.
+        size_t end_;
+        //! Last position with each hash, plus 1 (0 for none).
+        std::vector<size_t> head_;
+        //! Previous position with the same hash as each position, plus 1,
+        //! indexed by the position modulo the window size.
+        std::vector<size_t> prev_;
+        //! Symbols of the current block.
+        std::vector<Symbol> symbols_;
+    };
+
+    //! Get the header of zlib streams compressed with a level.
+    //! @param level Compression level, from 0 to 9.
+    //! @return The two bytes of the header, first byte first.
+    uint16_t zlib_header(int level);
+}
+
+#endif
@@ -0,0 +1,187 @@
+#include "DisplayList.hpp"
+#include <algorithm>
+#include <cmath>
+
+namespace svg
+{
+    namespace
+    {
+        //! Bounding box of a sequence of points.
+        BBox points_bbox(const Point *points, size_t count)
+        {
+            BBox box = {{0, 0}, {0, 0}};
+            if (count == 0)
+            {
+                return box;
+            }
+            box.min = box.max = points[0];
+            for (size_t i = 0; i < count; i++)
+            {
+                const Point &p = points[i];
+                box.min.x = std::min(box.min.x, p.x);
+                box.min.y = std::min(box.min.y, p.y);
+                box.max.x = std::max(box.max.x, p.x);
+                box.max.y = std::max(box.max.y, p.y);
+            }
+            box.max.x++;
+            box.max.y++;
+            return box;
+        }
+
+        //! Transform the radius of an ellipse whose axes stay aligned
+        //! with the X and Y axes: under scalings and rotations by multiples
+        //! of 90 degrees, or under any rotation and uniform scaling of a
+        //! circle.
+        //! @param l Linear part of the transformation.
+        //! @param radius Radius in X and Y axis.
+        //! @param result Transformed radius.
+        //! @return false if the transformed ellipse is turned or skewed.
+        bool aligned_radius(const Transform::Linear &l, const Point &radius, Point &result)
+        {
+            // Tolerance for the rounding errors of composed rotations,
+            // relative to the size of the coefficients.
+            const double size = std::fabs(l.xx) + std::fabs(l.xy) + std::fabs(l.yx) + std::fabs(l.yy);
+            const double eps = 1e-9 * size;
+            if (std::fabs(l.xy) <= eps && std::fabs(l.yx) <= eps)
+            {
+                result = {(int)::lround(radius.x * std::fabs(l.xx)), (int)::lround(radius.y * std::fabs(l.yy))};
+                return true;
+            }
+            if (std::fabs(l.xx) <= eps && std::fabs(l.yy) <= eps)
+            {
+                // The X axis is mapped to the Y axis, and the Y axis to the X axis.
+                result = {(int)::lround(radius.y * std::fabs(l.xy)), (int)::lround(radius.x * std::fabs(l.yx))};
+                return true;
+            }
+            double x_scale = l.xx * l.xx + l.yx * l.yx;
+            double y_scale = l.xy * l.xy + l.yy * l.yy;
+            if (radius.x == radius.y && std::fabs(x_scale - y_scale) <= eps * size &&
+                std::fabs(l.xx * l.xy + l.yx * l.yy) <= eps * size)
+            {
+                int r = (int)::lround(radius.x * std::sqrt(x_scale));
+                result = {r, r};
+                return true;
+            }
+            return false;
+        }
+    }
+
+    void DisplayList::add(DrawOp op, FillRule rule, const Color &color,
+                          const Point *points, size_t count, const Transform &transform)
+    {
+        DrawCommand command;
+        command.op = op;
+        command.rule = rule;
+        command.color = color;
+        command.first = (uint32_t)vertices_.size();
+        command.count = (uint32_t)count;
+        if (transform.identity())
+        {
+            vertices_.insert(vertices_.end(), points, points + count);
+        }
+        else
+        {
+            for (size_t i = 0; i < count; i++)
+            {
+                vertices_.push_back(transform.apply(points[i]));
+            }
+        }
+        command.bbox = points_bbox(vertices_.data() + command.first, count);
+        commands_.push_back(command);
+    }
+    void DisplayList::add_polygon(const Color &fill, const Point *points, size_t count,
+                                  FillRule rule, const Transform &transform)
+    {
+        add(DrawOp::Polygon, rule, fill, points, count, transform);
+    }
+    void DisplayList::add_polyline(const Color &stroke, const Point *points, size_t count,
+                                   const Transform &transform)
+    {
+        add(DrawOp::Polyline, FillRule::NonZero, stroke, points, count, transform);
+    }
+    void DisplayList::add_ellipse(const Color &fill, const Point &center, const Point &radius,
+                                  const Transform &transform)
+    {
+        Point c = transform.apply(center);
+        Transform::Linear l = transform.linear();
+        Point r;
+        if (!aligned_radius(l, radius, r))
+        {
+            // Turned or skewed: drawn as a polygon with vertices about
+            // 2 pixels apart, computed from the transformed axes.
+            double ax = radius.x * l.xx, ay = radius.x * l.yx;
+            double bx = radius.y * l.xy, by = radius.y * l.yy;
+            double extent = std::sqrt(ax * ax + ay * ay) + std::sqrt(bx * bx + by * by);
+            int n = (int)std::min(std::max(std::ceil(M_PI * extent), 16.0), 4096.0);
+            std::vector<Point> outline;
+            outline.reserve(n);
+            for (int i = 0; i < n; i++)
+            {
+                double t = 2 * M_PI * i / n;
+                Point p = {c.x + (int)::lround(ax * std::cos(t) + bx * std::sin(t)),
+                           c.y + (int)::lround(ay * std::cos(t) + by * std::sin(t))};
+                if (outline.empty() || p.x != outline.back().x || p.y != outline.back().y)
+                {
+                    outline.push_back(p);
+                }
+            }
+            add(DrawOp::Polygon, FillRule::NonZero, fill, outline.data(), outline.size(), Transform());
+            return;
+        }
+        DrawCommand command;
+        command.op = DrawOp::Ellipse;
+        command.rule = FillRule::NonZero;
+        command.color = fill;
+        command.bbox = {{c.x - r.x, c.y - r.y}, {c.x + r.x + 1, c.y + r.y + 1}};
+        command.first = (uint32_t)vertices_.size();
+        command.count = 2;
+        commands_.push_back(command);
+        vertices_.push_back(c);
+        vertices_.push_back(r);
+    }
+    const std::vector<DrawCommand> &DisplayList::commands() const
+    {
+        return commands_;
+    }
+    size_t DisplayList::size() const
+    {
+        return commands_.size();
+    }
+    void DisplayList::draw(const DrawCommand &command, PNGImage &img) const
+    {
+        const Point *points = vertices_.data() + command.first;
+        img.begin_shape();
+        switch (command.op)
+        {
+        case DrawOp::Polygon:
+            img.draw_polygon(points, command.count, command.color, command.rule);
+            break;
+        case DrawOp::Polyline:
+            img.draw_polyline(points, command.count, command.color);
+            break;
+        case DrawOp::Ellipse:
+            img.draw_ellipse(points[0], points[1], command.color);
+            break;
+        }
+    }
+    void DisplayList::draw(PNGImage &img) const
+    {
+        if (img.back_to_front())
+        {
+            for (auto it = commands_.rbegin(); it != commands_.rend(); ++it)
+            {
+                draw(*it, img);
+            }
+            return;
+        }
+        for (const DrawCommand &command : commands_)
+        {
+            draw(command, img);
+        }
+    }
+    void DisplayList::clear()
+    {
+        commands_.clear();
+        vertices_.clear();
+    }
+}
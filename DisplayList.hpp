@@ -0,0 +1,109 @@
+//! @file DisplayList.hpp
+#ifndef __svg_DisplayList_hpp__
+#define __svg_DisplayList_hpp__
+
+#include "Color.hpp"
+#include "Point.hpp"
+#include "PNGImage.hpp"
+#include "Transform.hpp"
+
+#include <cstdint>
+#include <vector>
+
+namespace svg
+{
+    //! Kind of shape drawn by a display list command.
+    enum class DrawOp : unsigned char
+    {
+        //! Filled polygon (see PNGImage::draw_polygon).
+        Polygon,
+        //! Connected line segments (see PNGImage::draw_polyline).
+        Polyline,
+        //! Filled ellipse; its 2 vertices are the center and the radius.
+        Ellipse
+    };
+
+    //! Command of a display list, drawing one shape.
+    //! Commands do not own their vertices: they refer to a range
+    //! of the vertex array shared by the whole list.
+    struct DrawCommand
+    {
+        //! Kind of shape.
+        DrawOp op;
+        //! Fill rule, for polygons.
+        FillRule rule;
+        //! Fill or stroke color.
+        Color color;
+        //! Box of pixels the shape may draw on.
+        BBox bbox;
+        //! Index of the first vertex in the vertex array.
+        uint32_t first;
+        //! Number of vertices.
+        uint32_t count;
+    };
+
+    //! Flat list of drawing commands compiled from SVG elements.
+    //! Groups and transforms are resolved when compiling (shapes are
+    //! added with their transformation, applied to their vertices
+    //! as they are copied), so the
+    //! list is drawn with a single loop over contiguous commands,
+    //! without virtual calls, and can be drawn any number of times
+    //! (on tiles, or on several images).
+    class DisplayList
+    {
+    public:
+        //! Add a polygon.
+        //! @param fill Color to use for the polygon fill.
+        //! @param points Points defining the polygon.
+        //! @param count Number of points.
+        //! @param rule Fill rule for self-intersecting outlines.
+        //! @param transform Transformation of the points.
+        void add_polygon(const Color &fill, const Point *points, size_t count,
+                         FillRule rule, const Transform &transform);
+        //! Add connected line segments.
+        //! @param stroke Color to use for the lines.
+        //! @param points Points defining the segments.
+        //! @param count Number of points.
+        //! @param transform Transformation of the points.
+        void add_polyline(const Color &stroke, const Point *points, size_t count,
+                          const Transform &transform);
+        //! Add an ellipse. When its axes stay aligned with the X and Y
+        //! axes, its center is transformed and its radius scaled along
+        //! each axis; an ellipse that is turned or skewed is added as
+        //! a polygon following its outline.
+        //! @param fill Color to use for the ellipse fill.
+        //! @param center Coordinates for the ellipse center.
+        //! @param radius Radius in X and Y axis.
+        //! @param transform Transformation of the ellipse.
+        void add_ellipse(const Color &fill, const Point &center, const Point &radius,
+                         const Transform &transform);
+        //! Get the commands, in drawing order.
+        //! @return Vector of commands.
+        const std::vector<DrawCommand> &commands() const;
+        //! Get the number of commands.
+        //! @return Number of commands.
+        size_t size() const;
+        //! Draw one command of the list.
+        //! @param command Command of this list.
+        //! @param img PNG image.
+        void draw(const DrawCommand &command, PNGImage &img) const;
+        //! Draw all commands, in order (or in reverse order when the
+        //! image draws back to front).
+        //! @param img PNG image.
+        void draw(PNGImage &img) const;
+        //! Remove all commands and vertices.
+        void clear();
+
+    private:
+        //! Add a command, copying and transforming its vertices, and
+        //! set its box to the box of the vertices.
+        void add(DrawOp op, FillRule rule, const Color &color,
+                 const Point *points, size_t count, const Transform &transform);
+        //! Commands, in drawing order.
+        std::vector<DrawCommand> commands_;
+        //! Vertices of all commands.
+        std::vector<Point> vertices_;
+    };
+}
+
+#endif
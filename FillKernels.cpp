@@ -0,0 +1,190 @@
+//! @file FillKernels.cpp
+#include "FillKernels.hpp"
+
+#include <algorithm>
+#include <cstdint>
+
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#define SVG_FILL_X86 1
+#include <immintrin.h>
+#endif
+
+namespace svg
+{
+    namespace
+    {
+        //! Runs shorter than this are filled without dispatching.
+        const size_t SHORT_RUN = 16;
+
+        void fill_rgb_scalar(Color *dst, size_t n, const Color &c)
+        {
+            std::fill(dst, dst + n, c);
+        }
+
+        void fill_32_scalar(uint32_t *dst, size_t n, uint32_t v)
+        {
+            std::fill(dst, dst + n, v);
+        }
+
+#ifdef SVG_FILL_X86
+        // Since 3 * 11 = 33, 11 is the inverse of 3 modulo 16 and 32:
+        // filling 11 * k pixels moves the address forward by k bytes
+        // modulo the vector size, which is how far the SIMD kernels
+        // fill before switching to aligned stores.
+
+        //! Number of pixels to fill before dst is aligned to a power of 2.
+        size_t pixels_to_alignment(const Color *dst, size_t align)
+        {
+            size_t misalign = (align - ((uintptr_t)dst & (align - 1))) & (align - 1);
+            return (misalign * 11) & (align - 1);
+        }
+
+        //! SSE2 kernel: 16 pixels per step, as 3 aligned 16-byte stores
+        //! of a 48-byte repeating pattern.
+        __attribute__((target("sse2")))
+        void fill_rgb_sse2(Color *dst, size_t n, const Color &c)
+        {
+            if (n < 32)
+            {
+                // Too short to pay for building the pattern.
+                fill_rgb_scalar(dst, n, c);
+                return;
+            }
+            size_t head = pixels_to_alignment(dst, 16);
+            fill_rgb_scalar(dst, head, c);
+            dst += head;
+            n -= head;
+            Color pattern[16];
+            fill_rgb_scalar(pattern, 16, c);
+            const __m128i v0 = _mm_loadu_si128((const __m128i *)pattern);
+            const __m128i v1 = _mm_loadu_si128((const __m128i *)pattern + 1);
+            const __m128i v2 = _mm_loadu_si128((const __m128i *)pattern + 2);
+            __m128i *p = (__m128i *)dst;
+            for (; n >= 16; n -= 16, p += 3)
+            {
+                _mm_store_si128(p, v0);
+                _mm_store_si128(p + 1, v1);
+                _mm_store_si128(p + 2, v2);
+            }
+            fill_rgb_scalar((Color *)p, n, c);
+        }
+
+        //! AVX2 kernel: 32 pixels per step, as 3 aligned 32-byte stores
+        //! of a 96-byte repeating pattern.
+        __attribute__((target("avx2")))
+        void fill_rgb_avx2(Color *dst, size_t n, const Color &c)
+        {
+            if (n < 256)
+            {
+                // Short runs do not gain from wider stores.
+                fill_rgb_sse2(dst, n, c);
+                return;
+            }
+            size_t head = pixels_to_alignment(dst, 32);
+            fill_rgb_scalar(dst, head, c);
+            dst += head;
+            n -= head;
+            Color pattern[32];
+            fill_rgb_scalar(pattern, 32, c);
+            const __m256i v0 = _mm256_loadu_si256((const __m256i *)pattern);
+            const __m256i v1 = _mm256_loadu_si256((const __m256i *)pattern + 1);
+            const __m256i v2 = _mm256_loadu_si256((const __m256i *)pattern + 2);
+            __m256i *p = (__m256i *)dst;
+            for (; n >= 32; n -= 32, p += 3)
+            {
+                _mm256_store_si256(p, v0);
+                _mm256_store_si256(p + 1, v1);
+                _mm256_store_si256(p + 2, v2);
+            }
+            fill_rgb_scalar((Color *)p, n, c);
+        }
+
+        //! SSE2 kernel for 4-byte pixels: 4 pixels per aligned store.
+        __attribute__((target("sse2")))
+        void fill_32_sse2(uint32_t *dst, size_t n, uint32_t v)
+        {
+            for (; n > 0 && ((uintptr_t)dst & 15) != 0; n--)
+            {
+                *dst++ = v;
+            }
+            const __m128i pattern = _mm_set1_epi32((int)v);
+            for (; n >= 4; n -= 4, dst += 4)
+            {
+                _mm_store_si128((__m128i *)dst, pattern);
+            }
+            fill_32_scalar(dst, n, v);
+        }
+
+        //! AVX2 kernel for 4-byte pixels: 8 pixels per aligned store.
+        __attribute__((target("avx2")))
+        void fill_32_avx2(uint32_t *dst, size_t n, uint32_t v)
+        {
+            for (; n > 0 && ((uintptr_t)dst & 31) != 0; n--)
+            {
+                *dst++ = v;
+            }
+            const __m256i pattern = _mm256_set1_epi32((int)v);
+            for (; n >= 8; n -= 8, dst += 8)
+            {
+                _mm256_store_si256((__m256i *)dst, pattern);
+            }
+            fill_32_scalar(dst, n, v);
+        }
+#endif
+
+        //! Select the fastest kernels supported by the CPU.
+        FillKernelInfo select_fill()
+        {
+            std::vector<FillKernelInfo> kernels = fill_kernels();
+            return kernels.back();
+        }
+    }
+
+    std::vector<FillKernelInfo> fill_kernels()
+    {
+        std::vector<FillKernelInfo> kernels;
+        kernels.push_back({"scalar", fill_rgb_scalar, fill_32_scalar});
+#ifdef SVG_FILL_X86
+        __builtin_cpu_init();
+        if (__builtin_cpu_supports("sse2"))
+        {
+            kernels.push_back({"sse2", fill_rgb_sse2, fill_32_sse2});
+        }
+        if (__builtin_cpu_supports("avx2"))
+        {
+            kernels.push_back({"avx2", fill_rgb_avx2, fill_32_avx2});
+        }
+#endif
+        return kernels;
+    }
+
+    void fill_rgb(Color *dst, size_t n, const Color &c)
+    {
+        // Short runs (most spans of small shapes) are not worth
+        // the indirect call.
+        if (n < SHORT_RUN)
+        {
+            for (size_t i = 0; i < n; i++)
+            {
+                dst[i] = c;
+            }
+            return;
+        }
+        static const FillRGBKernel kernel = select_fill().fill;
+        kernel(dst, n, c);
+    }
+
+    void fill_32(uint32_t *dst, size_t n, uint32_t v)
+    {
+        if (n < SHORT_RUN)
+        {
+            for (size_t i = 0; i < n; i++)
+            {
+                dst[i] = v;
+            }
+            return;
+        }
+        static const Fill32Kernel kernel = select_fill().fill32;
+        kernel(dst, n, v);
+    }
+}
@@ -0,0 +1,53 @@
+//! @file FillKernels.hpp
+#ifndef __svg_FillKernels_hpp__
+#define __svg_FillKernels_hpp__
+
+#include "Color.hpp"
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+namespace svg
+{
+    //! Kernel filling a run of packed RGB pixels with one color.
+    //! @param dst First pixel of the run.
+    //! @param n Number of pixels in the run.
+    //! @param c Color to use for the pixels.
+    typedef void (*FillRGBKernel)(Color *dst, size_t n, const Color &c);
+
+    //! Kernel filling a run of 4-byte pixels with one value.
+    //! @param dst First pixel of the run.
+    //! @param n Number of pixels in the run.
+    //! @param v Pixel value, with its bytes in memory order.
+    typedef void (*Fill32Kernel)(uint32_t *dst, size_t n, uint32_t v);
+
+    //! Named fill kernel implementation.
+    struct FillKernelInfo
+    {
+        //! Implementation name.
+        const char *name;
+        //! Kernel for 3-byte pixels.
+        FillRGBKernel fill;
+        //! Kernel for 4-byte pixels.
+        Fill32Kernel fill32;
+    };
+
+    //! Fill a run of packed RGB pixels with one color, using the
+    //! fastest kernel supported by the CPU (selected on first use).
+    //! @param dst First pixel of the run.
+    //! @param n Number of pixels in the run.
+    //! @param c Color to use for the pixels.
+    void fill_rgb(Color *dst, size_t n, const Color &c);
+    //! Fill a run of 4-byte pixels with one value, using the
+    //! fastest kernel supported by the CPU (selected on first use).
+    //! @param dst First pixel of the run.
+    //! @param n Number of pixels in the run.
+    //! @param v Pixel value, with its bytes in memory order.
+    void fill_32(uint32_t *dst, size_t n, uint32_t v);
+    //! Get the fill kernels supported by the CPU, slowest first.
+    //! The first one is always the portable scalar kernel.
+    //! @return Supported kernels.
+    std::vector<FillKernelInfo> fill_kernels();
+}
+#endif
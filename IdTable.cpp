@@ -0,0 +1,79 @@
+//! @file IdTable.cpp
+#include <cstring>
+#include "IdTable.hpp"
+
+namespace svg
+{
+    IdTable::IdTable() : entries_(64, Entry{Slice{nullptr, 0}, 0, nullptr}), count_(0)
+    {
+    }
+
+    size_t IdTable::slot(Slice id, uint32_t hash) const
+    {
+        size_t mask = entries_.size() - 1;
+        for (size_t i = hash & mask;; i = (i + 1) & mask)
+        {
+            const Entry &entry = entries_[i];
+            if (entry.id.data == nullptr ||
+                (entry.hash == hash && entry.id.size == id.size && std::memcmp(entry.id.data, id.data, id.size) == 0))
+            {
+                return i;
+            }
+        }
+    }
+
+    SVGElement *IdTable::find(Slice id) const
+    {
+        if (!id)
+        {
+            return nullptr;
+        }
+        return entries_[slot(id, hash_name(id))].element;
+    }
+
+    void IdTable::insert(Slice id, SVGElement *element)
+    {
+        uint32_t hash = hash_name(id);
+        Entry &entry = entries_[slot(id, hash)];
+        if (entry.id.data != nullptr)
+        {
+            entry.element = element;
+            return;
+        }
+        entry = Entry{id, hash, element};
+        count_++;
+        // At most half full, so that probe sequences stay short.
+        if (2 * count_ > entries_.size())
+        {
+            grow();
+        }
+    }
+
+    void IdTable::insert(const IdTable &other)
+    {
+        for (const Entry &entry : other.entries_)
+        {
+            if (entry.id.data != nullptr)
+            {
+                insert(entry.id, entry.element);
+            }
+        }
+    }
+    size_t IdTable::size() const
+    {
+        return count_;
+    }
+
+    void IdTable::grow()
+    {
+        std::vector<Entry> old(2 * entries_.size(), Entry{Slice{nullptr, 0}, 0, nullptr});
+        old.swap(entries_);
+        for (const Entry &entry : old)
+        {
+            if (entry.id.data != nullptr)
+            {
+                entries_[slot(entry.id, entry.hash)] = entry;
+            }
+        }
+    }
+}
@@ -0,0 +1,59 @@
+//! @file IdTable.hpp
+#ifndef __svg_IdTable_hpp__
+#define __svg_IdTable_hpp__
+
+#include <vector>
+#include "XMLReader.hpp"
+
+namespace svg
+{
+    class SVGElement;
+
+    //! Table of the SVG elements with an id attribute.
+    //! Open addressing with linear probing, keyed by the ids themselves:
+    //! the table does not copy them, so they must outlive it (interned
+    //! in the input or in an arena). Finding an id never inserts it.
+    class IdTable
+    {
+    public:
+        //! Constructor, creating an empty table.
+        IdTable();
+        //! Find the element with an id.
+        //! @param id Id.
+        //! @return The element, nullptr if there is none.
+        SVGElement *find(Slice id) const;
+        //! Add an element, replacing the one with the same id if any
+        //! (the last element with an id wins).
+        //! @param id Id, which must outlive the table.
+        //! @param element Element.
+        void insert(Slice id, SVGElement *element);
+        //! Add all the elements of another table, as if they were added
+        //! after the elements of this one.
+        //! @param other Table.
+        void insert(const IdTable &other);
+        //! Get the number of ids.
+        //! @return Number of ids.
+        size_t size() const;
+
+    private:
+        struct Entry
+        {
+            //! Id, with a null data pointer for an empty slot.
+            Slice id;
+            //! hash_name(id).
+            uint32_t hash;
+            //! Element.
+            SVGElement *element;
+        };
+        //! Find the slot of an id, or the empty slot where it would go.
+        size_t slot(Slice id, uint32_t hash) const;
+        //! Double the number of slots.
+        void grow();
+        //! Slots, a power of 2.
+        std::vector<Entry> entries_;
+        //! Number of ids.
+        size_t count_;
+    };
+}
+
+#endif
@@ -0,0 +1,169 @@
+//! @file Numbers.cpp
+#include <climits>
+#include <cmath>
+#include <cstdint>
+#include <cstdlib>
+#include <string>
+#include "Numbers.hpp"
+
+namespace svg
+{
+    namespace
+    {
+        bool is_digit(char c)
+        {
+            return c >= '0' && c <= '9';
+        }
+
+        bool is_space(char c)
+        {
+            return c == ' ' || c == '\t' || c == '\n' || c == '\r';
+        }
+
+        //! Powers of 10 that are exact as doubles.
+        const double POWERS_OF_10[] = {1e0, 1e1, 1e2, 1e3, 1e4, 1e5, 1e6, 1e7, 1e8, 1e9, 1e10, 1e11,
+                                       1e12, 1e13, 1e14, 1e15, 1e16, 1e17, 1e18, 1e19, 1e20, 1e21, 1e22};
+    }
+
+    bool parse_number(const char *&s, const char *end, double &value)
+    {
+        const char *p = s;
+        bool negative = false;
+        if (p < end && (*p == '+' || *p == '-'))
+        {
+            negative = *p == '-';
+            p++;
+        }
+        // The first 19 significant digits fit the mantissa; the other
+        // ones only change the exponent.
+        uint64_t mantissa = 0;
+        int digits = 0;
+        int exponent = 0;
+        bool any = false;
+        for (; p < end && is_digit(*p); p++)
+        {
+            any = true;
+            if (digits < 19)
+            {
+                mantissa = mantissa * 10 + (*p - '0');
+                digits += mantissa != 0;
+            }
+            else
+            {
+                exponent++;
+            }
+        }
+        if (p < end && *p == '.')
+        {
+            p++;
+            for (; p < end && is_digit(*p); p++)
+            {
+                any = true;
+                if (digits < 19)
+                {
+                    mantissa = mantissa * 10 + (*p - '0');
+                    digits += mantissa != 0;
+                    exponent--;
+                }
+            }
+        }
+        if (!any)
+        {
+            return false;
+        }
+        if (p < end && (*p == 'e' || *p == 'E'))
+        {
+            // Only an exponent with digits, so that units such as "em"
+            // are left alone.
+            const char *q = p + 1;
+            bool negative_exponent = false;
+            if (q < end && (*q == '+' || *q == '-'))
+            {
+                negative_exponent = *q == '-';
+                q++;
+            }
+            if (q < end && is_digit(*q))
+            {
+                int e = 0;
+                for (; q < end && is_digit(*q); q++)
+                {
+                    e = e < 100000 ? e * 10 + (*q - '0') : e;
+                }
+                exponent += negative_exponent ? -e : e;
+                p = q;
+            }
+        }
+        if (mantissa < ((uint64_t)1 << 53) && exponent >= -22 && exponent <= 22)
+        {
+            // Both factors are exact, so the result is correctly rounded.
+            value = exponent < 0 ? mantissa / POWERS_OF_10[-exponent] : mantissa * POWERS_OF_10[exponent];
+            value = negative ? -value : value;
+        }
+        else
+        {
+            // Rare: many significant digits or a large exponent.
+            value = std::strtod(std::string(s, p).c_str(), nullptr);
+        }
+        s = p;
+        return true;
+    }
+
+    void skip_separator(const char *&s, const char *end)
+    {
+        while (s < end && is_space(*s))
+        {
+            s++;
+        }
+        if (s < end && *s == ',')
+        {
+            s++;
+            while (s < end && is_space(*s))
+            {
+                s++;
+            }
+        }
+    }
+
+    int round_number(double value)
+    {
+        if (!(value > INT_MIN))
+        {
+            // Also NaN.
+            return value > 0 ? INT_MAX : INT_MIN;
+        }
+        if (value >= INT_MAX)
+        {
+            return INT_MAX;
+        }
+        return (int)std::lround(value);
+    }
+
+    size_t max_points(size_t length)
+    {
+        // A number takes at least one character and is followed by at
+        // least one character before the next one.
+        return (length + 1) / 2 / 2;
+    }
+
+    size_t parse_points(const char *s, const char *end, Point *points)
+    {
+        size_t count = 0;
+        skip_separator(s, end);
+        while (true)
+        {
+            double x, y;
+            if (!parse_number(s, end, x))
+            {
+                break;
+            }
+            skip_separator(s, end);
+            if (!parse_number(s, end, y))
+            {
+                break;
+            }
+            skip_separator(s, end);
+            points[count++] = Point{round_number(x), round_number(y)};
+        }
+        return count;
+    }
+}
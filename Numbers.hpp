@@ -0,0 +1,51 @@
+//! @file Numbers.hpp
+#ifndef __svg_Numbers_hpp__
+#define __svg_Numbers_hpp__
+
+#include <cstddef>
+#include "Point.hpp"
+
+namespace svg
+{
+    //! Parse a number with the SVG grammar: an optional sign, digits
+    //! with an optional decimal point (such as "12", "1.5", ".5" or
+    //! "3.") and an optional exponent (such as "1e-3").
+    //! Characters are only read between s and end.
+    //! @param s Position of the number, moved past it if there is one.
+    //! @param end End of the characters.
+    //! @param value Parsed number.
+    //! @return false (leaving s unchanged) if there is no number at s.
+    bool parse_number(const char *&s, const char *end, double &value);
+
+    //! Skip a separator of a list of numbers: white space with at
+    //! most one comma.
+    //! @param s Position, moved past the separator.
+    //! @param end End of the characters.
+    void skip_separator(const char *&s, const char *end);
+
+    //! Round a number to the nearest integer, saturating at the limits
+    //! of int.
+    //! @param value Number.
+    //! @return Integer.
+    int round_number(double value);
+
+    //! Get the largest number of points a list of coordinates can have.
+    //! @param length Number of characters of the list.
+    //! @return Number of points.
+    size_t max_points(size_t length);
+
+    //! Parse a list of coordinates, such as the points of a polygon,
+    //! rounding them to whole pixels. Numbers are separated by white
+    //! space and/or a comma, or by nothing when the next one starts
+    //! with a sign or a decimal point. Parsing stops at the first
+    //! character that is not part of the list, and an unpaired last
+    //! coordinate is ignored.
+    //! @param s First character.
+    //! @param end End of the characters.
+    //! @param points Storage for the points, with room for
+    //! max_points(end - s) points.
+    //! @return Number of points.
+    size_t parse_points(const char *s, const char *end, Point *points);
+}
+
+#endif
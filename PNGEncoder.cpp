@@ -0,0 +1,740 @@
+//! @file PNGEncoder.cpp
+#include <algorithm>
+#include <atomic>
+#include <cassert>
+#include <condition_variable>
+#include <cstdint>
+#include <cstdlib>
+#include <cstring>
+#include <deque>
+#include <mutex>
+#include <stdexcept>
+#include <thread>
+#include "Deflate.hpp"
+#include "PNGEncoder.hpp"
+
+namespace svg
+{
+    namespace
+    {
+        //! Bytes of filtered rows compressed as one piece.
+        const size_t BAND_SIZE = 256 * 1024;
+        //! Bytes before a band that its matches may refer to.
+        const size_t HISTORY_SIZE = 32768;
+
+        //! Band of rows, compressed by a worker, then written.
+        struct Band
+        {
+            //! Number of the band, from 0.
+            size_t number;
+            //! First row of the band.
+            int y0;
+            //! Row one past the end of the band.
+            int y1;
+            //! Rows as written, from the first one before the band that
+            //! is filtered again or used as the prior row (see
+            //! PNGWriter::State::compress).
+            std::vector<unsigned char> rows;
+            //! First row of rows.
+            int rows_first;
+            //! Whether a worker took the band.
+            bool taken;
+            //! Whether the band is compressed.
+            bool done;
+            //! Compressed bytes, as the data of an IDAT chunk.
+            std::vector<unsigned char> data;
+            //! Adler-32 of the filtered rows.
+            uint32_t adler;
+            //! CRC-32 of the chunk type and data.
+            uint32_t crc;
+        };
+
+        void put_32(std::vector<unsigned char> &out, uint32_t v)
+        {
+            const unsigned char bytes[4] = {(unsigned char)(v >> 24), (unsigned char)(v >> 16),
+                                            (unsigned char)(v >> 8), (unsigned char)v};
+            out.insert(out.end(), bytes, bytes + 4);
+        }
+
+        //! Append a chunk whose data is already in the output.
+        //! @param out Output, ending with the data of the chunk.
+        //! @param start Offset of the chunk (its length field) in the output.
+        void end_chunk(std::vector<unsigned char> &out, size_t start)
+        {
+            uint32_t length = (uint32_t)(out.size() - start - 8);
+            for (int i = 0; i < 4; i++)
+            {
+                out[start + i] = (unsigned char)(length >> (24 - 8 * i));
+            }
+            put_32(out, crc32(0, out.data() + start + 4, out.size() - start - 4));
+        }
+
+        void begin_chunk(std::vector<unsigned char> &out, const char *type)
+        {
+            put_32(out, 0);
+            out.insert(out.end(), type, type + 4);
+        }
+
+        //! Run a worker function on threads. Workers take the numbers of
+        //! the items to process, in order, from a shared counter.
+        //! @param threads Number of threads, 0 for one per hardware thread.
+        //! @param n Number of items.
+        //! @param worker Function called by each thread with the counter.
+        template <typename F>
+        void run_workers(unsigned threads, size_t n, F worker)
+        {
+            std::atomic<size_t> next(0);
+            if (threads == 0)
+            {
+                threads = std::max(std::thread::hardware_concurrency(), 1u);
+            }
+            threads = (unsigned)std::min<size_t>(threads, n);
+            std::vector<std::thread> pool;
+            for (unsigned i = 1; i < threads; i++)
+            {
+                pool.emplace_back([&]()
+                                  { worker(next); });
+            }
+            worker(next);
+            for (std::thread &t : pool)
+            {
+                t.join();
+            }
+        }
+
+        //! Color of a pixel as a key of ColorTable: red, green, blue and
+        //! alpha (255 without alpha) from the lowest byte.
+        uint32_t pixel_key(const unsigned char *p, int channels)
+        {
+            return p[0] | (uint32_t)p[1] << 8 | (uint32_t)p[2] << 16 | (uint32_t)(channels == 4 ? p[3] : 255) << 24;
+        }
+
+        //! Table of the colors of an image with at most 256 colors,
+        //! giving their indices in the palette.
+        class ColorTable
+        {
+        public:
+            ColorTable() : keys_(SLOTS), indices_(SLOTS, -1) {}
+            //! Find a color.
+            //! @param key Color.
+            //! @return Index of the color, -1 if it is not in the table.
+            int find(uint32_t key) const
+            {
+                return indices_[slot(key)];
+            }
+            //! Add a color, if it is not in the table yet.
+            //! @param key Color.
+            //! @return false if the color is new and the table is full.
+            bool insert(uint32_t key)
+            {
+                size_t i = slot(key);
+                if (indices_[i] < 0)
+                {
+                    if (colors_.size() == 256)
+                    {
+                        return false;
+                    }
+                    keys_[i] = key;
+                    indices_[i] = (int16_t)colors_.size();
+                    colors_.push_back(key);
+                }
+                return true;
+            }
+            //! Get the colors, in the order of their indices.
+            //! @return Colors.
+            const std::vector<uint32_t> &colors() const
+            {
+                return colors_;
+            }
+
+        private:
+            //! Number of slots, so that the table is at most a quarter full.
+            static const size_t SLOTS = 1024;
+            //! Find the slot of a color, or the empty slot where it goes.
+            size_t slot(uint32_t key) const
+            {
+                size_t i = (key * 2654435761u) >> 22;
+                while (indices_[i] >= 0 && keys_[i] != key)
+                {
+                    i = (i + 1) & (SLOTS - 1);
+                }
+                return i;
+            }
+            //! Color of each slot.
+            std::vector<uint32_t> keys_;
+            //! Index of the color of each slot, -1 for an empty slot.
+            std::vector<int16_t> indices_;
+            //! Colors, in the order they were added.
+            std::vector<uint32_t> colors_;
+        };
+
+        //! Find the colors of an image if it has at most 256, scanning
+        //! bands of rows in parallel.
+        //! @param colors Set to the colors.
+        //! @return false if the image has more than 256 colors.
+        bool find_palette(const unsigned char *pixels, int width, int height, size_t stride,
+                          int pixel_size, int channels, unsigned threads, std::vector<uint32_t> &colors)
+        {
+            const int band_rows = (int)std::max<size_t>(BAND_SIZE / ((size_t)width * pixel_size), 1);
+            const size_t n_bands = (height + band_rows - 1) / band_rows;
+            std::vector<ColorTable> tables(n_bands);
+            // Set when a band has too many colors, for the others to stop.
+            std::atomic<bool> too_many(false);
+            auto worker = [&](std::atomic<size_t> &next)
+            {
+                for (size_t b = next++; b < n_bands && !too_many; b = next++)
+                {
+                    ColorTable &table = tables[b];
+                    int y1 = std::min((int)(b + 1) * band_rows, height);
+                    for (int y = (int)b * band_rows; y < y1 && !too_many; y++)
+                    {
+                        const unsigned char *row = pixels + y * stride;
+                        // Neighbors often have the same color.
+                        uint32_t last = pixel_key(row, channels);
+                        bool fits = table.insert(last);
+                        for (int x = 1; x < width && fits; x++)
+                        {
+                            uint32_t key = pixel_key(row + (size_t)x * pixel_size, channels);
+                            if (key != last)
+                            {
+                                fits = table.insert(key);
+                                last = key;
+                            }
+                        }
+                        if (!fits)
+                        {
+                            too_many = true;
+                        }
+                    }
+                }
+            };
+            run_workers(threads, n_bands, worker);
+            if (too_many)
+            {
+                return false;
+            }
+            ColorTable all;
+            for (const ColorTable &table : tables)
+            {
+                for (uint32_t key : table.colors())
+                {
+                    if (!all.insert(key))
+                    {
+                        return false;
+                    }
+                }
+            }
+            colors = all.colors();
+            return true;
+        }
+
+        int paeth(int a, int b, int c)
+        {
+            int p = a + b - c;
+            int pa = std::abs(p - a), pb = std::abs(p - b), pc = std::abs(p - c);
+            return pa <= pb && pa <= pc ? a : pb <= pc ? b : c;
+        }
+
+        //! Filter a row.
+        //! @param type Filter type, from 0 (None) to 4 (Paeth).
+        //! @param prior Previous row (zeros for the first one).
+        //! @param row Row.
+        //! @param n Bytes per row.
+        //! @param bpp Bytes per pixel.
+        //! @param out Filtered row, after its filter type byte.
+        void apply_filter(int type, const unsigned char *prior, const unsigned char *row,
+                          size_t n, size_t bpp, unsigned char *out)
+        {
+            size_t first = std::min(bpp, n);
+            switch (type)
+            {
+            case 0:
+                std::memcpy(out, row, n);
+                break;
+            case 1:
+                std::memcpy(out, row, first);
+                for (size_t i = bpp; i < n; i++)
+                {
+                    out[i] = row[i] - row[i - bpp];
+                }
+                break;
+            case 2:
+                for (size_t i = 0; i < n; i++)
+                {
+                    out[i] = row[i] - prior[i];
+                }
+                break;
+            case 3:
+                for (size_t i = 0; i < first; i++)
+                {
+                    out[i] = row[i] - (prior[i] >> 1);
+                }
+                for (size_t i = bpp; i < n; i++)
+                {
+                    out[i] = row[i] - ((row[i - bpp] + prior[i]) >> 1);
+                }
+                break;
+            default:
+                for (size_t i = 0; i < first; i++)
+                {
+                    out[i] = row[i] - prior[i];
+                }
+                for (size_t i = bpp; i < n; i++)
+                {
+                    out[i] = row[i] - paeth(row[i - bpp], prior[i], prior[i - bpp]);
+                }
+                break;
+            }
+        }
+
+        //! Sum of the filtered bytes as signed differences.
+        size_t cost(const unsigned char *out, size_t n)
+        {
+            size_t sum = 0;
+            for (size_t i = 0; i < n; i++)
+            {
+                sum += out[i] < 128 ? out[i] : 256 - out[i];
+            }
+            return sum;
+        }
+
+        //! Filter a row with a filter or, if adaptive, with the filter
+        //! giving the smallest sum.
+        //! @param filter Filter.
+        //! @param prior Previous row (zeros for the first one).
+        //! @param row Row.
+        //! @param n Bytes per row.
+        //! @param bpp Bytes per pixel.
+        //! @param out Filter type byte followed by the filtered row.
+        //! @param trial Room for n + 1 bytes, for the adaptive filter.
+        void filter_row(PNGFilter filter, const unsigned char *prior, const unsigned char *row,
+                        size_t n, size_t bpp, unsigned char *out, unsigned char *trial)
+        {
+            if (filter != PNGFilter::Adaptive)
+            {
+                out[0] = (unsigned char)filter;
+                apply_filter(out[0], prior, row, n, bpp, out + 1);
+                return;
+            }
+            size_t best = SIZE_MAX;
+            for (int type = 0; type < 5; type++)
+            {
+                apply_filter(type, prior, row, n, bpp, trial + 1);
+                size_t sum = cost(trial + 1, n);
+                if (sum < best)
+                {
+                    best = sum;
+                    trial[0] = (unsigned char)type;
+                    std::memcpy(out, trial, n + 1);
+                }
+            }
+        }
+    }
+
+    PNGOptions::PNGOptions()
+        : level(6), filter(PNGFilter::Up), palette(true), threads(0)
+    {
+    }
+
+    struct PNGWriter::State
+    {
+        //! Function receiving the bytes of the file.
+        Sink sink;
+        int width;
+        int height;
+        //! Bytes per pixel of the rows given.
+        int pixel_size;
+        //! Channels written, without a palette.
+        int channels;
+        //! Compression level.
+        int level;
+        //! Whether the image is written with a palette.
+        bool indexed;
+        //! Colors of the palette, in the order of their indices.
+        ColorTable palette;
+        //! Bits per pixel of indexed images.
+        int depth;
+        //! Bytes per row as written.
+        size_t row_size;
+        //! Bytes per pixel for the filters, rounded up to 1 for indices.
+        size_t bpp;
+        //! Filter of the rows.
+        PNGFilter filter;
+        //! Bytes per filtered row, with its filter type.
+        size_t filtered_size;
+        //! Rows per band.
+        int band_rows;
+        //! Rows before a band that its matches may refer to.
+        int history_rows;
+        //! Number of bands.
+        size_t n_bands;
+        //! Rows of the band being filled, as written, after the last
+        //! rows of the previous band that it needs.
+        std::vector<unsigned char> rows;
+        //! First row of rows.
+        int rows_first;
+        //! Next row to write.
+        int next_row;
+        //! Number of the band being filled.
+        size_t next_band;
+        //! Adler-32 of the bands written so far.
+        uint32_t adler;
+        //! Compressor, without threads.
+        Deflater deflater;
+        //! Guards the pending bands and the flags of the bands.
+        std::mutex mutex;
+        //! Signaled when a band is added, or the threads must stop.
+        std::condition_variable added;
+        //! Signaled when a band is compressed.
+        std::condition_variable compressed;
+        //! Bands given to the threads and not written yet, in order.
+        std::deque<std::unique_ptr<Band>> pending;
+        //! Largest number of pending bands.
+        size_t max_pending;
+        //! Whether the threads must stop.
+        bool stop;
+        //! Compressing threads, none to compress bands when they are full.
+        std::vector<std::thread> pool;
+
+        State(int level) : deflater(level) {}
+        //! Convert a row to the bytes written: indices packed from the most
+        //! significant bit, or pixels without the bytes that are not channels.
+        //! @param src First byte of the row.
+        //! @param dst row_size bytes.
+        void pack(const unsigned char *src, unsigned char *dst) const
+        {
+            if (indexed)
+            {
+                std::fill(dst, dst + row_size, 0);
+                uint32_t last = pixel_key(src, channels);
+                int index = palette.find(last);
+                for (int x = 0; x < width; x++)
+                {
+                    uint32_t key = pixel_key(src + (size_t)x * pixel_size, channels);
+                    if (key != last)
+                    {
+                        index = palette.find(key);
+                        last = key;
+                    }
+                    if (index < 0)
+                    {
+                        throw std::logic_error("PNGWriter: pixel color not in the colors given");
+                    }
+                    size_t bit = (size_t)x * depth;
+                    dst[bit / 8] |= index << (8 - depth - bit % 8);
+                }
+            }
+            else if (pixel_size == channels)
+            {
+                std::memcpy(dst, src, row_size);
+            }
+            else
+            {
+                for (int x = 0; x < width; x++)
+                {
+                    std::memcpy(dst + (size_t)x * channels, src + (size_t)x * pixel_size, channels);
+                }
+            }
+        }
+        //! Filter and compress a band.
+        void compress(Band &band, Deflater &deflater) const
+        {
+            // The last rows of the previous band are filtered again
+            // (the same way), for the matches to refer to them.
+            const int first = std::max(band.y0 - history_rows, 0);
+            auto row = [&](int y)
+            {
+                return band.rows.data() + (size_t)(y - band.rows_first) * row_size;
+            };
+            const std::vector<unsigned char> zeros(first > 0 ? 0 : row_size, 0);
+            std::vector<unsigned char> filtered((size_t)(band.y1 - first) * filtered_size);
+            std::vector<unsigned char> trial(filtered_size);
+            const unsigned char *prior = first > 0 ? row(first - 1) : zeros.data();
+            for (int y = first; y < band.y1; y++)
+            {
+                filter_row(filter, prior, row(y), row_size, bpp,
+                           &filtered[(size_t)(y - first) * filtered_size], trial.data());
+                prior = row(y);
+            }
+            std::vector<unsigned char>().swap(band.rows);
+            size_t history = (size_t)(band.y0 - first) * filtered_size;
+            band.adler = adler32(1, filtered.data() + history, filtered.size() - history);
+            const char *type = "IDAT";
+            band.data.assign(type, type + 4);
+            if (band.number == 0)
+            {
+                uint16_t zlib = zlib_header(level);
+                band.data.push_back((unsigned char)(zlib >> 8));
+                band.data.push_back((unsigned char)zlib);
+            }
+            deflater.compress(filtered.data() + history, filtered.size() - history, history,
+                              band.number + 1 == n_bands, band.data);
+            band.crc = crc32(0, band.data.data(), band.data.size());
+        }
+        //! Write a compressed band as an IDAT chunk.
+        void write(Band &band)
+        {
+            size_t size = (size_t)(band.y1 - band.y0) * filtered_size;
+            adler = band.number == 0 ? band.adler : adler32_combine(adler, band.adler, size);
+            if (band.number + 1 == n_bands)
+            {
+                // The stream ends with the checksum of all the bands.
+                size_t end = band.data.size();
+                put_32(band.data, adler);
+                band.crc = crc32(band.crc, band.data.data() + end, 4);
+            }
+            std::vector<unsigned char> length;
+            put_32(length, (uint32_t)(band.data.size() - 4));
+            sink(length.data(), 4);
+            put_32(band.data, band.crc);
+            sink(band.data.data(), band.data.size());
+        }
+        //! Write the compressed bands at the front of the pending ones,
+        //! waiting for them while more are pending than a limit.
+        //! @param limit Largest number of bands left pending.
+        void write_pending(size_t limit)
+        {
+            std::unique_lock<std::mutex> lock(mutex);
+            while (!pending.empty() && (pending.size() > limit || pending.front()->done))
+            {
+                if (!pending.front()->done)
+                {
+                    compressed.wait(lock);
+                    continue;
+                }
+                std::unique_ptr<Band> band = std::move(pending.front());
+                pending.pop_front();
+                lock.unlock();
+                write(*band);
+                lock.lock();
+            }
+        }
+        //! Compress the bands added to the pending ones, on a thread.
+        void run_worker()
+        {
+            Deflater deflater(level);
+            std::unique_lock<std::mutex> lock(mutex);
+            for (;;)
+            {
+                Band *band = nullptr;
+                added.wait(lock, [&]()
+                           {
+                               for (const std::unique_ptr<Band> &b : pending)
+                               {
+                                   if (!b->taken)
+                                   {
+                                       band = b.get();
+                                       break;
+                                   }
+                               }
+                               return stop || band != nullptr; });
+                if (stop)
+                {
+                    return;
+                }
+                band->taken = true;
+                lock.unlock();
+                compress(*band, deflater);
+                lock.lock();
+                band->done = true;
+                compressed.notify_one();
+            }
+        }
+        //! Hand the band being filled to the threads, or compress and
+        //! write it without threads.
+        void submit()
+        {
+            std::unique_ptr<Band> band(new Band());
+            band->number = next_band++;
+            band->y0 = (int)band->number * band_rows;
+            band->y1 = next_row;
+            band->rows_first = rows_first;
+            band->taken = false;
+            band->done = false;
+            // The next band starts with the rows it needs from this one.
+            rows_first = std::max(next_row - history_rows - 1, 0);
+            std::vector<unsigned char> kept(rows.end() - (size_t)(next_row - rows_first) * row_size, rows.end());
+            band->rows.swap(rows);
+            rows.swap(kept);
+            if (pool.empty())
+            {
+                compress(*band, deflater);
+                write(*band);
+                return;
+            }
+            {
+                std::lock_guard<std::mutex> lock(mutex);
+                pending.push_back(std::move(band));
+            }
+            added.notify_one();
+            write_pending(max_pending);
+        }
+    };
+
+    PNGWriter::PNGWriter(int width, int height, int pixel_size, int channels,
+                         const std::vector<uint32_t> &colors, const PNGOptions &options,
+                         const Sink &sink)
+        : state_(new State(options.level))
+    {
+        State &s = *state_;
+        s.sink = sink;
+        s.width = width;
+        s.height = height;
+        s.pixel_size = pixel_size;
+        s.channels = channels;
+        s.level = options.level;
+        s.indexed = false;
+        ColorTable all;
+        if (options.palette && !colors.empty())
+        {
+            s.indexed = std::all_of(colors.begin(), colors.end(), [&](uint32_t key)
+                                    { return all.insert(key); });
+        }
+        if (s.indexed)
+        {
+            // The same order whatever the order of the colors given, with
+            // the translucent colors first since the tRNS chunk ends at the
+            // last of them.
+            std::vector<uint32_t> sorted = all.colors();
+            std::sort(sorted.begin(), sorted.end(), [](uint32_t a, uint32_t b)
+                      { return (a >> 24 == 255) != (b >> 24 == 255) ? a >> 24 != 255 : a < b; });
+            for (uint32_t key : sorted)
+            {
+                s.palette.insert(key);
+            }
+        }
+        const size_t n_colors = s.palette.colors().size();
+        s.depth = n_colors <= 2 ? 1 : n_colors <= 4 ? 2 : n_colors <= 16 ? 4 : 8;
+        s.row_size = s.indexed ? ((size_t)width * s.depth + 7) / 8 : (size_t)width * channels;
+        s.bpp = s.indexed ? 1 : channels;
+        // Indices are not filtered, as libpng recommends: they do not
+        // change smoothly, and rows repeated as a whole are matched anyway.
+        s.filter = s.indexed ? PNGFilter::None : options.filter;
+        s.filtered_size = s.row_size + 1;
+        s.band_rows = (int)std::max<size_t>(BAND_SIZE / s.filtered_size, 1);
+        s.history_rows = (int)((HISTORY_SIZE + s.filtered_size - 1) / s.filtered_size);
+        s.n_bands = (height + s.band_rows - 1) / s.band_rows;
+        s.rows.reserve((size_t)(s.history_rows + 1 + s.band_rows) * s.row_size);
+        s.rows_first = 0;
+        s.next_row = 0;
+        s.next_band = 0;
+        s.adler = 1;
+        s.stop = false;
+
+        std::vector<unsigned char> png;
+        const unsigned char SIGNATURE[8] = {0x89, 'P', 'N', 'G', '\r', '\n', 0x1A, '\n'};
+        png.insert(png.end(), SIGNATURE, SIGNATURE + 8);
+        size_t start = png.size();
+        begin_chunk(png, "IHDR");
+        put_32(png, width);
+        put_32(png, height);
+        // Indexed, RGB or RGBA, no interlacing.
+        const unsigned char header[5] = {(unsigned char)(s.indexed ? s.depth : 8),
+                                         (unsigned char)(s.indexed ? 3 : channels == 4 ? 6 : 2), 0, 0, 0};
+        png.insert(png.end(), header, header + 5);
+        end_chunk(png, start);
+        if (s.indexed)
+        {
+            start = png.size();
+            begin_chunk(png, "PLTE");
+            size_t translucent = 0;
+            for (uint32_t key : s.palette.colors())
+            {
+                const unsigned char rgb[3] = {(unsigned char)key, (unsigned char)(key >> 8),
+                                              (unsigned char)(key >> 16)};
+                png.insert(png.end(), rgb, rgb + 3);
+                translucent += key >> 24 != 255;
+            }
+            end_chunk(png, start);
+            if (translucent > 0)
+            {
+                start = png.size();
+                begin_chunk(png, "tRNS");
+                for (size_t i = 0; i < translucent; i++)
+                {
+                    png.push_back((unsigned char)(s.palette.colors()[i] >> 24));
+                }
+                end_chunk(png, start);
+            }
+        }
+        s.sink(png.data(), png.size());
+
+        unsigned threads = options.threads;
+        if (threads == 0)
+        {
+            threads = std::max(std::thread::hardware_concurrency(), 1u);
+        }
+        threads = (unsigned)std::min<size_t>(threads, s.n_bands);
+        s.max_pending = 2 * threads;
+        for (unsigned i = 0; i < threads && threads > 1; i++)
+        {
+            s.pool.emplace_back([&s]()
+                                { s.run_worker(); });
+        }
+    }
+
+    PNGWriter::~PNGWriter()
+    {
+        {
+            std::lock_guard<std::mutex> lock(state_->mutex);
+            state_->stop = true;
+        }
+        state_->added.notify_all();
+        for (std::thread &t : state_->pool)
+        {
+            t.join();
+        }
+    }
+
+    void PNGWriter::write(const unsigned char *pixels, size_t stride, int rows)
+    {
+        State &s = *state_;
+        assert(s.next_row + rows <= s.height);
+        for (int i = 0; i < rows; i++)
+        {
+            size_t end = s.rows.size();
+            s.rows.resize(end + s.row_size);
+            s.pack(pixels + i * stride, &s.rows[end]);
+            s.next_row++;
+            if (s.next_row == std::min((int)(s.next_band + 1) * s.band_rows, s.height))
+            {
+                s.submit();
+            }
+        }
+    }
+
+    void PNGWriter::finish()
+    {
+        State &s = *state_;
+        assert(s.next_row == s.height);
+        s.write_pending(0);
+        std::vector<unsigned char> png;
+        begin_chunk(png, "IEND");
+        end_chunk(png, 0);
+        s.sink(png.data(), png.size());
+    }
+
+    void encode_png(const unsigned char *pixels, int width, int height, size_t stride,
+                    int pixel_size, int channels, const PNGOptions &options,
+                    std::vector<unsigned char> &png)
+    {
+        encode_png(pixels, width, height, stride, pixel_size, channels, options,
+                   [&png](const unsigned char *data, size_t size)
+                   { png.insert(png.end(), data, data + size); });
+    }
+
+    void encode_png(const unsigned char *pixels, int width, int height, size_t stride,
+                    int pixel_size, int channels, const PNGOptions &options,
+                    const PNGWriter::Sink &sink)
+    {
+        std::vector<uint32_t> colors;
+        if (options.palette && !find_palette(pixels, width, height, stride, pixel_size, channels,
+                                             options.threads, colors))
+        {
+            colors.clear();
+        }
+        PNGWriter writer(width, height, pixel_size, channels, colors, options, sink);
+        writer.write(pixels, stride, height);
+        writer.finish();
+    }
+}
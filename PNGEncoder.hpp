@@ -0,0 +1,137 @@
+//! @file PNGEncoder.hpp
+#ifndef __svg_PNGEncoder_hpp__
+#define __svg_PNGEncoder_hpp__
+
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <memory>
+#include <vector>
+
+namespace svg
+{
+    //! Filter applied to each row of a PNG image before compression,
+    //! predicting every byte from the bytes to its left and above.
+    enum class PNGFilter
+    {
+        //! Bytes are kept as they are.
+        None,
+        //! Difference with the pixel to the left.
+        Sub,
+        //! Difference with the pixel above.
+        Up,
+        //! Difference with the average of the pixels to the left and above.
+        Average,
+        //! Difference with the Paeth predictor of the pixels to the left,
+        //! above and above to the left.
+        Paeth,
+        //! For each row, the filter giving the smallest sum of absolute
+        //! differences (the libpng heuristic), trying the five filters.
+        Adaptive
+    };
+
+    //! Options of the PNG encoder.
+    struct PNGOptions
+    {
+        //! Default constructor, setting the default options.
+        PNGOptions();
+        //! Compression level, from 0 (stored, fastest) to 9 (smallest).
+        int level;
+        //! Filter of the rows, except with a palette (the rows of indices
+        //! are not filtered).
+        PNGFilter filter;
+        //! Whether to write images with at most 256 colors (such as
+        //! flat-color drawings) with a palette, using 1, 2, 4 or 8 bits
+        //! per pixel.
+        bool palette;
+        //! Number of compressing threads, 0 for one per hardware thread.
+        unsigned threads;
+    };
+
+    //! Streaming PNG encoder, writing an image given one band of rows
+    //! at a time, from top to bottom, while the next rows are produced.
+    //! Rows are filtered and compressed in bands of about 256 KiB, in
+    //! the background by the threads when there are several, and the
+    //! compressed bands are written in order, each as an IDAT chunk,
+    //! as soon as possible. At most two bands per thread are pending,
+    //! so the memory used does not depend on the image height.
+    class PNGWriter
+    {
+    public:
+        //! Function receiving the bytes of the file, in order.
+        typedef std::function<void(const unsigned char *, size_t)> Sink;
+        //! Constructor, writing the header of the file.
+        //! @param width Image width.
+        //! @param height Image height.
+        //! @param pixel_size Bytes per pixel of the rows given (3 or 4).
+        //! @param channels Number of channels written: 3 for RGB, taken
+        //! from the first 3 bytes of each pixel, or 4 for RGBA.
+        //! @param colors Colors the pixels may have, in any order, as red,
+        //! green, blue and alpha bytes (255 without alpha) from the lowest
+        //! one. With at most 256 different colors, and options.palette,
+        //! the image is written with a palette; if empty, or with more
+        //! colors, it is written with its channels.
+        //! @param options Encoder options.
+        //! @param sink Function receiving the bytes of the file.
+        PNGWriter(int width, int height, int pixel_size, int channels,
+                  const std::vector<uint32_t> &colors, const PNGOptions &options,
+                  const Sink &sink);
+        //! Writers own threads, so they are not copyable.
+        PNGWriter(const PNGWriter &) = delete;
+        //! Writers own threads, so they are not assignable.
+        PNGWriter &operator=(const PNGWriter &) = delete;
+        //! Destructor, stopping the threads (the file is incomplete
+        //! unless finish was called).
+        ~PNGWriter();
+        //! Write the next rows of the image.
+        //! @param pixels First byte of the first row.
+        //! @param stride Bytes per row.
+        //! @param rows Number of rows.
+        //! @throws std::logic_error if the image is written with a palette
+        //! and a pixel has a color that was not given to the constructor.
+        void write(const unsigned char *pixels, size_t stride, int rows);
+        //! Write the end of the file, once all rows are written.
+        void finish();
+
+    private:
+        //! State of the encoder and its threads.
+        struct State;
+        std::unique_ptr<State> state_;
+    };
+
+    //! Encode an image as a PNG file.
+    //! The colors of the image are counted first, in parallel, stopping
+    //! at the 257th one, so that images with few colors are written with
+    //! a palette (and a tRNS chunk for translucent colors).
+    //! Rows are then written by a PNGWriter, which compresses each band
+    //! of about 256 KiB by any of the threads, into pieces of one deflate
+    //! stream (see Deflater), so the file does not depend on the number
+    //! of threads.
+    //! @param pixels First byte of the first row.
+    //! @param width Image width.
+    //! @param height Image height.
+    //! @param stride Bytes per row.
+    //! @param pixel_size Bytes per pixel (3 or 4).
+    //! @param channels Number of channels written: 3 for RGB, taken from
+    //! the first 3 bytes of each pixel, or 4 for RGBA.
+    //! @param options Encoder options.
+    //! @param png Bytes of the file, appended to.
+    void encode_png(const unsigned char *pixels, int width, int height, size_t stride,
+                    int pixel_size, int channels, const PNGOptions &options,
+                    std::vector<unsigned char> &png);
+    //! Encode an image as a PNG file given to a function, as encode_png
+    //! into a vector does.
+    //! @param pixels First byte of the first row.
+    //! @param width Image width.
+    //! @param height Image height.
+    //! @param stride Bytes per row.
+    //! @param pixel_size Bytes per pixel (3 or 4).
+    //! @param channels Number of channels written (3 or 4).
+    //! @param options Encoder options.
+    //! @param sink Function receiving the bytes of the file, in order.
+    void encode_png(const unsigned char *pixels, int width, int height, size_t stride,
+                    int pixel_size, int channels, const PNGOptions &options,
+                    const PNGWriter::Sink &sink);
+}
+
+#endif
@@ -1,52 +1,129 @@
 #include "PNGImage.hpp"
+#include "FillKernels.hpp"
+#include "CoverageRasterizer.hpp"
 
 #include <stdexcept>
 #include <cmath>
 #include <cstring>
 #include <algorithm>
 #include <cassert>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <memory>
+#include <new>
 
 #define STBI_ONLY_PNG
 #define STB_IMAGE_IMPLEMENTATION
 #include "external/stb/stb_image.h"
-#define STB_IMAGE_WRITE_IMPLEMENTATION
-#include "external/stb/stb_image_write.h"
 
 namespace svg
 {
+    namespace
+    {
+        //! Bytes per pixel of a pixel format.
+        int bytes_per_pixel_of(PixelFormat format)
+        {
+            return format == PixelFormat::RGB8 ? 3 : 4;
+        }
+
+        //! 4-byte pixel value with its bytes in memory order.
+        uint32_t pixel_32(const Color &c, rgb_value alpha)
+        {
+            const unsigned char bytes[4] = {c.red, c.green, c.blue, alpha};
+            uint32_t v;
+            ::memcpy(&v, bytes, sizeof(v));
+            return v;
+        }
+    }
+
     PNGImage::PNGImage(const std::string &png_file_name)
     {
         int dummy;
-        pixels_ = (Color *)::stbi_load(png_file_name.c_str(),
-                                       &width_, &height_,
-                                       &dummy, 3);
+        pixels_ = ::stbi_load(png_file_name.c_str(),
+                              &width_, &height_,
+                              &dummy, 3);
         if (pixels_ == nullptr)
         {
             throw std::runtime_error(png_file_name + ": could not load image!");
         }
+        format_ = PixelFormat::RGB8;
+        bpp_ = 3;
+        first_row_ = 0;
+        stored_rows_ = height_;
+        clip_ = {{0, 0}, {width_, height_}};
+        owner_ = true;
+        antialias_ = false;
+        mask_ = nullptr;
+        occluded_pixels_ = 0;
+        shape_mark_ = 255;
     }
     PNGImage::PNGImage(int w, int h)
+        : PNGImage(w, h, Color{255, 255, 255})
+    {
+    }
+    PNGImage::PNGImage(int w, int h, const Color &background, PixelFormat format)
+        : PNGImage(w, h, 0, h, background, format)
+    {
+    }
+    PNGImage::PNGImage(int w, int h, int y0, int y1, const Color &background, PixelFormat format)
     {
         assert(w > 0 && h > 0);
-        size_t sz = w * h * sizeof(Color);
-        pixels_ = (Color *)::stbi__malloc(sz);
+        assert(y0 >= 0 && y0 < y1 && y1 <= h);
         width_ = w;
         height_ = h;
-        ::memset(pixels_, 0xFF, sz);
+        format_ = format;
+        bpp_ = bytes_per_pixel_of(format);
+        first_row_ = y0;
+        stored_rows_ = y1 - y0;
+        // Aligned to cache lines, so that 4-byte pixels never
+        // straddle them and vector stores can be aligned.
+        void *mem = nullptr;
+        if (::posix_memalign(&mem, 64, (size_t)w * stored_rows_ * bpp_) != 0)
+        {
+            throw std::bad_alloc();
+        }
+        pixels_ = (unsigned char *)mem;
+        clip_ = {{0, y0}, {w, y1}};
+        owner_ = true;
+        antialias_ = false;
+        mask_ = nullptr;
+        occluded_pixels_ = 0;
+        shape_mark_ = 255;
+        clear(background);
     }
-    void PNGImage::save(const std::string &png_file_name) const
+    PNGImage::PNGImage(PNGImage &image, const BBox &region)
+        : width_(image.width_), height_(image.height_),
+          format_(image.format_), bpp_(image.bpp_),
+          pixels_(image.pixels_),
+          first_row_(image.first_row_), stored_rows_(image.stored_rows_),
+          clip_(image.clip_.intersect(region)), owner_(false),
+          antialias_(image.antialias_), mask_(image.mask_),
+          occluded_pixels_(0), shape_mark_(255)
     {
-        ::stbi_write_png(png_file_name.c_str(),
-                         width_,
-                         height_,
-                         3,
-                         pixels_,
-                         width_ * 3);
+        count_open_pixels();
+    }
+    void PNGImage::save(const std::string &png_file_name, const PNGOptions &options) const
+    {
+        assert(first_row_ == 0 && stored_rows_ == height_);
+        // PNG has no padding byte, so RGBX pixels are written as RGB.
+        std::vector<unsigned char> png;
+        encode_png(pixels_, width_, height_, stride(), bpp_, format_ == PixelFormat::RGBA8 ? 4 : 3,
+                   options, png);
+        std::unique_ptr<FILE, int (*)(FILE *)> file(::fopen(png_file_name.c_str(), "wb"), ::fclose);
+        if (!file || ::fwrite(png.data(), 1, png.size(), file.get()) != png.size())
+        {
+            throw std::runtime_error(png_file_name + ": could not save image!");
+        }
     }
 
     PNGImage::~PNGImage()
     {
-        stbi_image_free(pixels_);
+        if (owner_)
+        {
+            // Both stbi_load and posix_memalign memory is released by free.
+            ::free(pixels_);
+        }
     }
 
     int PNGImage::width() const
@@ -57,155 +134,1041 @@ namespace svg
     {
         return height_;
     }
+    PixelFormat PNGImage::format() const
+    {
+        return format_;
+    }
+    int PNGImage::bytes_per_pixel() const
+    {
+        return bpp_;
+    }
+    size_t PNGImage::stride() const
+    {
+        return (size_t)width_ * bpp_;
+    }
+    const BBox &PNGImage::clip() const
+    {
+        return clip_;
+    }
     Color &PNGImage::at(int x, int y)
     {
         assert(x >= 0 && x < width_);
         assert(y >= 0 && y < height_);
-        return pixels_[y * width_ + x];
+        return *(Color *)(row(y) + (size_t)x * bpp_);
     }
     Color PNGImage::at(int x, int y) const
     {
         assert(x >= 0 && x < width_);
         assert(y >= 0 && y < height_);
-        return pixels_[y * width_ + x];
+        return *(const Color *)(row(y) + (size_t)x * bpp_);
     }
-    void PNGImage::draw_line(const Point &a, const Point &b, const Color &c)
+    rgb_value PNGImage::alpha(int x, int y) const
     {
-        //  Bresenham Algorithm.
-        int x_from = a.x;
-        int y_from = a.y;
-        int x_to = b.x;
-        int y_to = b.y;
-        int dy = y_to - y_from;
-        int dx = x_to - x_from;
-        int step_x = 1, step_y = 1;
-        if (dy < 0)
+        assert(x >= 0 && x < width_);
+        assert(y >= 0 && y < height_);
+        if (format_ != PixelFormat::RGBA8)
         {
-            dy = -dy;
-            step_y = -1;
+            return 255;
         }
-        if (dx < 0)
+        return row(y)[(size_t)x * bpp_ + 3];
+    }
+    unsigned char *PNGImage::row(int y)
+    {
+        assert(y >= first_row_ && y < first_row_ + stored_rows_);
+        return pixels_ + (size_t)(y - first_row_) * stride();
+    }
+    const unsigned char *PNGImage::row(int y) const
+    {
+        assert(y >= first_row_ && y < first_row_ + stored_rows_);
+        return pixels_ + (size_t)(y - first_row_) * stride();
+    }
+    void PNGImage::set_antialias(bool on)
+    {
+        antialias_ = on;
+    }
+    bool PNGImage::antialias() const
+    {
+        return antialias_;
+    }
+    BBox PNGImage::drawn_box(const BBox &box) const
+    {
+        const int margin = antialias_ ? 2 : 0;
+        BBox grown = {{box.min.x - margin, box.min.y - margin},
+                      {box.max.x + margin, box.max.y + margin}};
+        return grown.intersect(clip_);
+    }
+    void PNGImage::set_occlusion_mask(unsigned char *mask)
+    {
+        mask_ = mask;
+        shape_mark_ = 255;
+        count_open_pixels();
+    }
+    bool PNGImage::back_to_front() const
+    {
+        return mask_ != nullptr;
+    }
+    void PNGImage::begin_shape()
+    {
+        if (mask_ == nullptr)
+        {
+            return;
+        }
+        if (shape_mark_ < 255)
+        {
+            shape_mark_++;
+            return;
+        }
+        // Out of marks (or marks set by other images sharing the mask):
+        // all the pixels set so far now belong to earlier shapes.
+        for (int y = clip_.min.y; y < clip_.max.y; y++)
+        {
+            unsigned char *m = mask_row(y);
+            for (int x = clip_.min.x; x < clip_.max.x; x++)
+            {
+                m[x] = m[x] != 0;
+            }
+        }
+        shape_mark_ = 2;
+    }
+    unsigned long long PNGImage::occluded_pixels() const
+    {
+        return occluded_pixels_;
+    }
+    unsigned char *PNGImage::mask_row(int y)
+    {
+        return mask_ + (size_t)(y - first_row_) * width_;
+    }
+    void PNGImage::count_open_pixels()
+    {
+        open_pixels_.clear();
+        if (mask_ == nullptr || clip_.empty())
         {
-            dx = -dx;
-            step_x = -1;
+            return;
         }
-        dy *= 2;
-        dx *= 2;
-        at(x_from, y_from) = c;
-        if (dx > dy)
+        for (int y = clip_.min.y; y < clip_.max.y; y++)
         {
-            int fraction = dy - (dx / 2);
-            while (x_from != x_to)
+            const unsigned char *m = mask_row(y);
+            open_pixels_.push_back((int)std::count(m + clip_.min.x, m + clip_.max.x, 0));
+        }
+    }
+    bool PNGImage::occluded(const BBox &box) const
+    {
+        if (mask_ == nullptr)
+        {
+            return false;
+        }
+        BBox b = box.intersect(clip_);
+        for (int y = b.min.y; y < b.max.y; y++)
+        {
+            if (open_pixels_[y - clip_.min.y] == 0)
+            {
+                continue;
+            }
+            const unsigned char *m = mask_ + (size_t)(y - first_row_) * width_;
+            if (::memchr(m + b.min.x, 0, b.max.x - b.min.x) != nullptr)
+            {
+                return false;
+            }
+        }
+        return true;
+    }
+    void PNGImage::clear(const Color &c, rgb_value alpha)
+    {
+        if (clip_.empty())
+        {
+            return;
+        }
+        const size_t n_rows = clip_.max.y - clip_.min.y;
+        if (clip_.min.x == 0 && clip_.max.x == width_)
+        {
+            // Full rows are contiguous, so they are filled as one run.
+            if (c.red == c.green && c.green == c.blue &&
+                (bpp_ == 3 || alpha == c.red))
+            {
+                // All bytes are equal (as for white).
+                ::memset(row(clip_.min.y), c.red, n_rows * stride());
+            }
+            else if (bpp_ == 3)
+            {
+                fill_rgb((Color *)row(clip_.min.y), n_rows * width_, c);
+            }
+            else
+            {
+                fill_32((uint32_t *)row(clip_.min.y), n_rows * width_, pixel_32(c, alpha));
+            }
+            return;
+        }
+        for (int y = clip_.min.y; y < clip_.max.y; y++)
+        {
+            unsigned char *p = row(y) + (size_t)clip_.min.x * bpp_;
+            size_t n = clip_.max.x - clip_.min.x;
+            if (bpp_ == 3)
+            {
+                fill_rgb((Color *)p, n, c);
+            }
+            else
             {
-                if (fraction >= 0)
+                fill_32((uint32_t *)p, n, pixel_32(c, alpha));
+            }
+        }
+    }
+    void PNGImage::plot(int x, int y, const Color &c)
+    {
+        if (x >= clip_.min.x && x < clip_.max.x &&
+            y >= clip_.min.y && y < clip_.max.y)
+        {
+            if (mask_ != nullptr)
+            {
+                unsigned char &m = mask_row(y)[x];
+                if (m)
                 {
-                    y_from += step_y;
-                    fraction -= dx;
+                    occluded_pixels_ += m != shape_mark_;
+                    return;
                 }
-                x_from += step_x;
-                fraction += dy;
-                at(x_from, y_from) = c;
+                m = shape_mark_;
+                open_pixels_[y - clip_.min.y]--;
             }
+            unsigned char *p = row(y) + (size_t)x * bpp_;
+            p[0] = c.red;
+            p[1] = c.green;
+            p[2] = c.blue;
+            if (bpp_ == 4)
+            {
+                p[3] = 255;
+            }
+        }
+    }
+    void PNGImage::fill_span(int x0, int x1, int y, const Color &c)
+    {
+        // Clip once per span instead of once per pixel.
+        if (y < clip_.min.y || y >= clip_.max.y)
+        {
+            return;
+        }
+        x0 = std::max(x0, clip_.min.x);
+        x1 = std::min(x1, clip_.max.x);
+        if (x0 >= x1)
+        {
+            return;
+        }
+        if (mask_ != nullptr)
+        {
+            fill_span_occluded(x0, x1, y, c);
+            return;
+        }
+        write_span(x0, x1, y, c);
+    }
+    void PNGImage::write_span(int x0, int x1, int y, const Color &c)
+    {
+        unsigned char *p = row(y) + (size_t)x0 * bpp_;
+        if (bpp_ == 3)
+        {
+            fill_rgb((Color *)p, x1 - x0, c);
         }
         else
         {
-            int fraction = dx - (dy >> 1);
-            while (y_from != y_to)
+            // Drawn pixels are opaque.
+            fill_32((uint32_t *)p, x1 - x0, pixel_32(c, 255));
+        }
+    }
+    void PNGImage::fill_span_occluded(int x0, int x1, int y, const Color &c)
+    {
+        int &open = open_pixels_[y - clip_.min.y];
+        unsigned char *m = mask_row(y);
+        // Pixels set before by the same shape are not counted.
+        auto count_occluded = [&](int from, int to)
+        {
+            occluded_pixels_ += (to - from) - std::count(m + from, m + to, shape_mark_);
+        };
+        if (open == 0)
+        {
+            // The whole row is covered by shapes drawn before.
+            count_occluded(x0, x1);
+            return;
+        }
+        // Only the runs of unset pixels are written.
+        int x = x0;
+        while (x < x1)
+        {
+            const unsigned char *set = (const unsigned char *)::memchr(m + x, 0, x1 - x);
+            int run_start = set == nullptr ? x1 : (int)(set - m);
+            count_occluded(x, run_start);
+            if (run_start == x1)
+            {
+                break;
+            }
+            const unsigned char *end = std::find_if(m + run_start, m + x1, [](unsigned char b)
+                                                    { return b != 0; });
+            int run_end = (int)(end - m);
+            write_span(run_start, run_end, y, c);
+            ::memset(m + run_start, shape_mark_, run_end - run_start);
+            open -= run_end - run_start;
+            x = run_end;
+        }
+    }
+    void PNGImage::fill_column(int x, int y0, int y1, const Color &c)
+    {
+        if (x < clip_.min.x || x >= clip_.max.x)
+        {
+            return;
+        }
+        y0 = std::max(y0, clip_.min.y);
+        y1 = std::min(y1, clip_.max.y);
+        if (y0 >= y1)
+        {
+            return;
+        }
+        if (mask_ != nullptr)
+        {
+            for (int y = y0; y < y1; y++)
+            {
+                plot(x, y, c);
+            }
+            return;
+        }
+        const size_t step = stride();
+        unsigned char *p = row(y0) + (size_t)x * bpp_;
+        for (int y = y0; y < y1; y++, p += step)
+        {
+            p[0] = c.red;
+            p[1] = c.green;
+            p[2] = c.blue;
+            if (bpp_ == 4)
+            {
+                p[3] = 255;
+            }
+        }
+    }
+    void PNGImage::draw_line(const Point &a, const Point &b, const Color &c)
+    {
+        draw_segment(a, b, c, true);
+    }
+    void PNGImage::draw_polyline(const Point *points, size_t count, const Color &c, bool closed)
+    {
+        if (count < 2)
+        {
+            if (closed && count == 1)
+            {
+                draw_segment(points[0], points[0], c, true);
+            }
+            return;
+        }
+        if (antialias_)
+        {
+            for (size_t i = 0; i + 1 < count; i++)
+            {
+                draw_line_aa(points[i], points[i + 1], c);
+            }
+            if (closed)
+            {
+                draw_line_aa(points[count - 1], points[0], c);
+            }
+            return;
+        }
+        // Each segment starts on the last pixel of the previous one.
+        draw_segment(points[0], points[1], c, true);
+        for (size_t i = 1; i + 1 < count; i++)
+        {
+            draw_segment(points[i], points[i + 1], c, false);
+        }
+        if (closed)
+        {
+            draw_segment(points[count - 1], points[0], c, false);
+        }
+    }
+    void PNGImage::draw_segment(const Point &a, const Point &b, const Color &c, bool include_first)
+    {
+        if (antialias_)
+        {
+            draw_line_aa(a, b, c);
+            return;
+        }
+        if (clip_.empty())
+        {
+            return;
+        }
+        if (a.y == b.y)
+        {
+            int x0 = std::min(a.x, b.x);
+            int x1 = std::max(a.x, b.x);
+            if (!include_first && a.x < b.x)
+            {
+                x0++;
+            }
+            else if (!include_first)
+            {
+                x1--;
+            }
+            fill_span(x0, x1 + 1, a.y, c);
+            return;
+        }
+        if (a.x == b.x)
+        {
+            int y0 = std::min(a.y, b.y);
+            int y1 = std::max(a.y, b.y);
+            if (!include_first && a.y < b.y)
+            {
+                y0++;
+            }
+            else if (!include_first)
+            {
+                y1--;
+            }
+            fill_column(a.x, y0, y1 + 1, c);
+            return;
+        }
+        //  Bresenham Algorithm, stepping along the major axis.
+        //  Only the steps whose pixel lies inside of the clipping
+        //  region are walked, so off-canvas parts of a line cost
+        //  nothing, and the pixels drawn are the ones the full walk
+        //  would draw.
+        const bool x_major = std::abs((long long)b.x - a.x) > std::abs((long long)b.y - a.y);
+        const long long major_from = x_major ? a.x : a.y;
+        const long long major_to = x_major ? b.x : b.y;
+        const long long minor_from = x_major ? a.y : a.x;
+        const long long minor_to = x_major ? b.y : b.x;
+        const int step_major = major_to < major_from ? -1 : 1;
+        const int step_minor = minor_to < minor_from ? -1 : 1;
+        const long long steps = std::abs(major_to - major_from);
+        const long long d_minor = 2 * std::abs(minor_to - minor_from);
+        // The fraction after k major steps and m minor steps is
+        // d_minor - steps + 2 * (k * |minor delta| - m * steps),
+        // and each minor step keeps it in [-2 * steps, 0) once
+        // decided, which gives m in closed form.
+        // k * |minor delta| is below 2^64 for any int coordinates.
+        auto minor_steps = [&](long long k, long long *rest) -> long long
+        {
+            if (k == 0)
+            {
+                *rest = 0;
+                return 0;
+            }
+            unsigned long long t = (unsigned long long)k * (unsigned long long)(d_minor / 2);
+            long long q = (long long)(t / (unsigned long long)steps);
+            long long r = (long long)(t % (unsigned long long)steps);
+            if (2 * r >= steps)
+            {
+                *rest = r - steps;
+                return q + 1;
+            }
+            *rest = r;
+            return q;
+        };
+        auto minor_at = [&](long long k) -> long long
+        {
+            long long rest;
+            return minor_steps(k, &rest);
+        };
+        long long k_first = include_first ? 0 : 1;
+        long long k_last = steps;
+        const bool inside = clip_.min.x <= std::min(a.x, b.x) && std::max(a.x, b.x) < clip_.max.x &&
+                            clip_.min.y <= std::min(a.y, b.y) && std::max(a.y, b.y) < clip_.max.y;
+        if (!inside)
+        {
+            // Steps whose major coordinate is inside of the clipping region.
+            const long long major_min = x_major ? clip_.min.x : clip_.min.y;
+            const long long major_max = (x_major ? clip_.max.x : clip_.max.y) - 1;
+            const long long minor_min = x_major ? clip_.min.y : clip_.min.x;
+            const long long minor_max = (x_major ? clip_.max.y : clip_.max.x) - 1;
+            k_first = std::max(k_first, step_major > 0 ? major_min - major_from : major_from - major_max);
+            k_last = std::min(k_last, step_major > 0 ? major_max - major_from : major_from - major_min);
+            // Minor steps whose minor coordinate is inside of it; the count
+            // only grows with k, so the matching steps are found by bisection.
+            const long long m_min = step_minor > 0 ? minor_min - minor_from : minor_from - minor_max;
+            const long long m_max = step_minor > 0 ? minor_max - minor_from : minor_from - minor_min;
+            if (k_first > k_last || minor_at(k_first) > m_max || minor_at(k_last) < m_min)
+            {
+                return;
+            }
+            long long lo = k_first, hi = k_last;
+            while (lo < hi)
+            {
+                long long mid = lo + (hi - lo) / 2;
+                if (minor_at(mid) >= m_min)
+                {
+                    hi = mid;
+                }
+                else
+                {
+                    lo = mid + 1;
+                }
+            }
+            k_first = lo;
+            hi = k_last;
+            while (lo < hi)
+            {
+                long long mid = hi - (hi - lo) / 2;
+                if (minor_at(mid) <= m_max)
+                {
+                    lo = mid;
+                }
+                else
+                {
+                    hi = mid - 1;
+                }
+            }
+            k_last = hi;
+        }
+        long long rest;
+        long long m = minor_steps(k_first, &rest);
+        long long fraction = d_minor - steps + 2 * rest;
+        const long long d_major = 2 * steps;
+        int major = (int)(major_from + step_major * k_first);
+        int minor = (int)(minor_from + step_minor * m);
+        int x = x_major ? major : minor;
+        int y = x_major ? minor : major;
+        if (d_minor == d_major)
+        {
+            // 45 degree diagonal: one pixel per row.
+            const int step_x = x_major ? step_major : step_minor;
+            const int step_y = x_major ? step_minor : step_major;
+            if (mask_ != nullptr)
+            {
+                for (long long k = k_first; k <= k_last; k++, x += step_x, y += step_y)
+                {
+                    plot(x, y, c);
+                }
+                return;
+            }
+            const ptrdiff_t step = step_x * (ptrdiff_t)bpp_ + step_y * (ptrdiff_t)stride();
+            unsigned char *p = row(y) + (size_t)x * bpp_;
+            for (long long k = k_first; k <= k_last; k++, p += step)
             {
-                if (fraction >= 0)
+                p[0] = c.red;
+                p[1] = c.green;
+                p[2] = c.blue;
+                if (bpp_ == 4)
                 {
-                    x_from += step_x;
-                    fraction -= dy;
+                    p[3] = 255;
                 }
-                y_from += step_y;
-                fraction += dx;
-                at(x_from, y_from) = c;
             }
+            return;
+        }
+        // Run-slice: the pixels between two minor steps form a run
+        // along the major axis, whose length follows from the fraction
+        // with one division, and which is set as a whole.
+        for (long long k = k_first; k <= k_last;)
+        {
+            long long run = 1;
+            if (fraction < 0)
+            {
+                run += (-fraction + d_minor - 1) / d_minor;
+            }
+            run = std::min(run, k_last - k + 1);
+            int first = major;
+            int last = (int)(major + step_major * (run - 1));
+            if (x_major)
+            {
+                fill_span(std::min(first, last), std::max(first, last) + 1, minor, c);
+            }
+            else
+            {
+                fill_column(minor, std::min(first, last), std::max(first, last) + 1, c);
+            }
+            k += run;
+            major = (int)(last + step_major);
+            minor += step_minor;
+            fraction += run * d_minor - d_major;
         }
     }
 
-    void PNGImage::draw_polygon(const std::vector<Point> &points, const Color &c)
+    namespace
     {
-        int x_min = width(), x_max = 0, y_min = height(), y_max = 0;
-        for (const Point &p : points)
+        //! Polygon edge used by the scanline rasterizer.
+        //! The X coordinate at the current row is kept as an exact
+        //! fraction x + rem / dy, so that it can be advanced from
+        //! row to row without divisions.
+        struct Edge
+        {
+            //! First row crossed by the edge.
+            int y_top;
+            //! Row after the last row crossed by the edge.
+            int y_bottom;
+            //! Integer part of X at the current row.
+            int x;
+            //! Fractional part of X at the current row (numerator).
+            int rem;
+            //! Integer part of the X increment per row.
+            int step;
+            //! Fractional part of the X increment per row (numerator).
+            int inc;
+            //! Vertical extent of the edge (denominator).
+            int dy;
+            //! Winding direction: +1 for downward edges, -1 for upward ones.
+            int winding;
+
+            //! X at the current row, rounded to the nearest pixel
+            //! (halfway cases away from zero, as std::round does).
+            int rounded_x() const
+            {
+                return x + (x >= 0 ? 2 * rem >= dy : 2 * rem > dy);
+            }
+            //! Move an edge that is still at its first row down to a later row.
+            //! @param row Row to move to.
+            void skip_to(int row)
+            {
+                long long n = (long long)(row - y_top) * inc;
+                x += (row - y_top) * step + (int)(n / dy);
+                rem = (int)(n % dy);
+            }
+            //! Move to the next row.
+            void advance()
+            {
+                x += step;
+                rem += inc;
+                if (rem >= dy)
+                {
+                    x++;
+                    rem -= dy;
+                }
+            }
+        };
+
+        //! Order edges by their exact X at the current row.
+        bool edge_before(const Edge &a, const Edge &b)
         {
-            x_min = std::min(x_min, p.x);
-            x_max = std::max(x_max, p.x);
-            y_min = std::min(y_min, p.y);
-            y_max = std::max(y_max, p.y);
+            if (a.x != b.x)
+            {
+                return a.x < b.x;
+            }
+            return (long long)a.rem * b.dy < (long long)b.rem * a.dy;
         }
 
-        std::vector<double> seg;
-        for (int y = y_min; y < y_max; y++)
+        //! Build the edge table of a polygon, sorted by first row.
+        //! Horizontal edges are left out, since they cross no row.
+        void build_edge_table(const Point *points, size_t count, std::vector<Edge> &edges)
         {
-            for (size_t i = 0; i < points.size(); i++)
+            edges.reserve(count);
+            for (size_t i = 0; i < count; i++)
             {
                 Point a = points[i];
-                Point b = points[(i + 1) % points.size()];
-                if (y < std::min(a.y, b.y) || y > std::max(a.y, b.y))
+                Point b = points[(i + 1) % count];
+                if (a.y == b.y)
                 {
                     continue;
                 }
-                if (a.y != b.y)
+                Edge e;
+                e.winding = 1;
+                if (a.y > b.y)
+                {
+                    std::swap(a, b);
+                    e.winding = -1;
+                }
+                e.y_top = a.y;
+                e.y_bottom = b.y;
+                e.x = a.x;
+                e.rem = 0;
+                e.dy = b.y - a.y;
+                int dx = b.x - a.x;
+                // Floor division, so that 0 <= inc < dy.
+                e.step = dx / e.dy;
+                e.inc = dx % e.dy;
+                if (e.inc < 0)
+                {
+                    e.step--;
+                    e.inc += e.dy;
+                }
+                edges.push_back(e);
+            }
+            std::sort(edges.begin(), edges.end(),
+                      [](const Edge &a, const Edge &b)
+                      { return a.y_top < b.y_top; });
+        }
+    }
+
+    void PNGImage::draw_polygon(const Point *points, size_t count, const Color &c, FillRule rule)
+    {
+        if (count == 0)
+        {
+            return;
+        }
+        if (antialias_)
+        {
+            draw_polygon_aa(points, count, c, rule);
+            return;
+        }
+        std::vector<Edge> edges;
+        build_edge_table(points, count, edges);
+
+        // Active edge list: edges crossing the current row, kept
+        // sorted by X. Edges cover rows [y_top, y_bottom), so a
+        // vertex shared by two edges is only counted once.
+        // Only rows inside of the clipping region are scanned.
+        std::vector<Edge> active;
+        size_t next = 0;
+        int y = clip_.min.y;
+        while ((next < edges.size() || !active.empty()) && y < clip_.max.y)
+        {
+            if (active.empty() && edges[next].y_top > y)
+            {
+                // Skip rows crossed by no edge.
+                y = edges[next].y_top;
+                if (y >= clip_.max.y)
+                {
+                    break;
+                }
+            }
+            // Retire finished edges and activate the ones starting here.
+            size_t n = 0;
+            for (size_t i = 0; i < active.size(); i++)
+            {
+                if (active[i].y_bottom > y)
                 {
-                    double x_inters = (double)(y - a.y) * (b.x - a.x) / (double)(b.y - a.y) + a.x;
-                    seg.push_back(x_inters);
+                    active[n++] = active[i];
                 }
             }
-            std::sort(seg.begin(), seg.end());
-            size_t i_s = 0;
-            while ((i_s + 1) < seg.size())
+            active.resize(n);
+            for (; next < edges.size() && edges[next].y_top <= y; next++)
             {
-                Point a = {(int)round(seg.at(i_s)), y};
-                Point b = {(int)round(seg.at(i_s + 1)), y};
-                if (a.x == b.x)
+                // Edges starting above the clipping region join late.
+                if (edges[next].y_bottom > y)
                 {
-                    i_s++;
+                    active.push_back(edges[next]);
+                    active.back().skip_to(y);
+                }
+            }
+            // The list is almost sorted from the previous row,
+            // so an insertion sort is close to linear here.
+            for (size_t i = 1; i < active.size(); i++)
+            {
+                Edge e = active[i];
+                size_t j = i;
+                for (; j > 0 && edge_before(e, active[j - 1]); j--)
+                {
+                    active[j] = active[j - 1];
+                }
+                active[j] = e;
+            }
+            // Fill the spans that are inside according to the fill rule.
+            int winding = 0;
+            for (size_t i = 0; i + 1 < active.size(); i++)
+            {
+                if (rule == FillRule::EvenOdd)
+                {
+                    winding ^= 1;
                 }
                 else
                 {
-                    draw_line(a, b, c);
-                    i_s += 2;
+                    winding += active[i].winding;
+                }
+                if (winding != 0)
+                {
+                    fill_span(active[i].rounded_x(), active[i + 1].rounded_x() + 1, y, c);
                 }
             }
-            seg.clear();
-        }
-        for (size_t i = 0; i < points.size(); i++)
-        {
-            draw_line(points[i], points[(i + 1) % points.size()], c);
+            for (Edge &e : active)
+            {
+                e.advance();
+            }
+            y++;
         }
+        draw_polyline(points, count, c, true);
     }
 
-    void PNGImage::draw_ellipse(const Point &center, const Point &radius, const Color &fill)
+    namespace
     {
-        draw_line(center.translate({-radius.x, 0}),
-                  center.translate({+radius.x, 0}),
-                  fill);
-        int x0 = radius.x;
-        int dx = 0;
-        for (int y = 1; y <= radius.y; y++)
+        //! Test of the original floating-point ellipse search,
+        //! which the integer search falls back to at the boundary.
+        //! @param x X distance from the center.
+        //! @param y Y distance from the center.
+        //! @param radius Radius in X and Y axis.
+        //! @return true if (x, y) is taken as inside of the ellipse.
+        bool inside_ellipse_float(int x, int y, const Point &radius)
         {
             double vy = (double)y / (double)radius.y;
             vy *= vy;
+            double vx = (double)x / (double)radius.x;
+            vx *= vx;
+            return vx + vy <= 1;
+        }
+
+        //! Find the half-width of an ellipse row.
+        //! The search starts from the half-width of the row above,
+        //! less its decrease from the row before plus one, and walks
+        //! inward until x^2 ry^2 + y^2 rx^2 <= rx^2 ry^2, updating the
+        //! left side incrementally. Within 2^-40 of the boundary the
+        //! floating-point test decides, so the rows are the ones the
+        //! original search gave, rounding errors included.
+        //! @param x0 Half-width of the row above.
+        //! @param dx Decrease of the half-width at the row above.
+        //! @param y Row, counted from the center.
+        //! @param radius Radius in X and Y axis.
+        //! @return Half-width of the row.
+        int ellipse_row(int x0, int dx, int y, const Point &radius)
+        {
             int x1 = x0 - (dx - 1);
+            if (radius.x < 0 || radius.y < 0 || radius.x >= 32768 || radius.y >= 32768)
+            {
+                // The products would overflow 64 bits.
+                for (; x1 > 0 && !inside_ellipse_float(x1, y, radius); x1--)
+                {
+                }
+                return x1;
+            }
+            const long long rx2 = (long long)radius.x * radius.x;
+            const long long ry2 = (long long)radius.y * radius.y;
+            const long long rhs = rx2 * ry2;
+            const long long band = rhs >> 40;
+            long long lhs = (long long)x1 * x1 * ry2 + (long long)y * y * rx2;
             for (; x1 > 0; x1--)
             {
-                double vx = (double)x1 / (double)radius.x;
-                vx *= vx;
-                if (vx + vy <= 1)
+                if (lhs < rhs - band ||
+                    (lhs <= rhs + band && inside_ellipse_float(x1, y, radius)))
                 {
                     break;
                 }
+                lhs -= (2LL * x1 - 1) * ry2;
+            }
+            return x1;
+        }
+    }
+
+    const std::vector<int> &PNGImage::ellipse_half_widths(const Point &radius, int rows)
+    {
+        EllipseSpans &spans = ellipse_spans_;
+        if (spans.widths.empty() || spans.radius.x != radius.x || spans.radius.y != radius.y)
+        {
+            spans.radius = radius;
+            spans.widths.assign(1, radius.x);
+            spans.dx = 0;
+        }
+        while ((int)spans.widths.size() <= rows)
+        {
+            int y = (int)spans.widths.size();
+            int x0 = spans.widths.back();
+            int x1 = ellipse_row(x0, spans.dx, y, radius);
+            spans.dx = x0 - x1;
+            spans.widths.push_back(x1);
+        }
+        return spans.widths;
+    }
+
+    void PNGImage::draw_ellipse(const Point &center, const Point &radius, const Color &fill)
+    {
+        if (antialias_)
+        {
+            draw_ellipse_aa(center, radius, fill);
+            return;
+        }
+        if (clip_.empty())
+        {
+            return;
+        }
+        // Rows up to the farthest one of the clipping region.
+        long long reach = std::max((long long)center.y - clip_.min.y,
+                                   (long long)clip_.max.y - 1 - center.y);
+        int rows = (int)std::min<long long>(std::max(radius.y, 0), reach);
+        const std::vector<int> &widths = ellipse_half_widths(radius, rows);
+        fill_span(center.x - widths[0], center.x + widths[0] + 1, center.y, fill);
+        for (int y = 1; y <= rows; y++)
+        {
+            fill_span(center.x - widths[y], center.x + widths[y] + 1, center.y - y, fill);
+            fill_span(center.x - widths[y], center.x + widths[y] + 1, center.y + y, fill);
+        }
+    }
+
+    void PNGImage::blend_span(int x0, int x1, int y, const Color &c, float coverage)
+    {
+        if (coverage >= 1.0f)
+        {
+            fill_span(x0, x1, y, c);
+            return;
+        }
+        if (y < clip_.min.y || y >= clip_.max.y)
+        {
+            return;
+        }
+        x0 = std::max(x0, clip_.min.x);
+        x1 = std::min(x1, clip_.max.x);
+        // 8-bit fixed point weights.
+        const int a = (int)(coverage * 256.0f + 0.5f);
+        const int na = 256 - a;
+        unsigned char *p = row(y) + (size_t)x0 * bpp_;
+        for (int x = x0; x < x1; x++, p += bpp_)
+        {
+            if (format_ == PixelFormat::RGBA8 && p[3] != 255)
+            {
+                // Compositing over a translucent pixel: the color
+                // weights are the coverage and the part of the old
+                // alpha left uncovered.
+                const int w_src = a * 255;
+                const int w_dst = p[3] * na;
+                const int w = w_src + w_dst;
+                if (w == 0)
+                {
+                    continue;
+                }
+                p[0] = (rgb_value)((c.red * w_src + p[0] * w_dst + w / 2) / w);
+                p[1] = (rgb_value)((c.green * w_src + p[1] * w_dst + w / 2) / w);
+                p[2] = (rgb_value)((c.blue * w_src + p[2] * w_dst + w / 2) / w);
+                p[3] = (rgb_value)((w + 128) >> 8);
+                continue;
+            }
+            p[0] = (rgb_value)((p[0] * na + c.red * a + 128) >> 8);
+            p[1] = (rgb_value)((p[1] * na + c.green * a + 128) >> 8);
+            p[2] = (rgb_value)((p[2] * na + c.blue * a + 128) >> 8);
+        }
+    }
+
+    void PNGImage::fill_coverage(CoverageRasterizer &shape, const Color &c, FillRule rule)
+    {
+        std::vector<CoverageSpan> spans;
+        for (int y = shape.first_row(); y < shape.end_row(); y++)
+        {
+            shape.sweep_row(y, rule, spans);
+            for (const CoverageSpan &s : spans)
+            {
+                blend_span(s.x0, s.x1, y, c, s.coverage);
+            }
+        }
+    }
+
+    // The anti-aliased fillers place pixel (x, y) on the square
+    // [x, x + 1[ x [y, y + 1[, so integer points lie at pixel
+    // centers, (x + 0.5, y + 0.5). Shapes are grown by half a pixel
+    // so they have the same extent as their aliased versions.
+
+    namespace
+    {
+        //! Point with real coordinates.
+        struct Vec
+        {
+            double x, y;
+        };
+
+        //! Pixel center of a point.
+        Vec center_of(const Point &p)
+        {
+            return {p.x + 0.5, p.y + 0.5};
+        }
+
+        //! Add a closed outline to a coverage rasterizer.
+        void add_outline(CoverageRasterizer &shape, const std::vector<Vec> &v)
+        {
+            for (size_t i = 0; i < v.size(); i++)
+            {
+                const Vec &a = v[i];
+                const Vec &b = v[(i + 1) % v.size()];
+                shape.add_edge(a.x, a.y, b.x, b.y);
+            }
+        }
+    }
+
+    void PNGImage::draw_line_aa(const Point &a, const Point &b, const Color &c)
+    {
+        // A line is a rectangle one pixel wide, extended by half a
+        // pixel past each end point.
+        Vec p = center_of(a), q = center_of(b);
+        double dx = q.x - p.x, dy = q.y - p.y;
+        double len = std::sqrt(dx * dx + dy * dy);
+        // Half-length vectors along (t) and across (n) the line.
+        Vec t = {0.5, 0.0};
+        if (len > 0)
+        {
+            t = {0.5 * dx / len, 0.5 * dy / len};
+        }
+        Vec n = {-t.y, t.x};
+        CoverageRasterizer shape(0, width_, clip_);
+        add_outline(shape, {{p.x - t.x + n.x, p.y - t.y + n.y},
+                            {q.x + t.x + n.x, q.y + t.y + n.y},
+                            {q.x + t.x - n.x, q.y + t.y - n.y},
+                            {p.x - t.x - n.x, p.y - t.y - n.y}});
+        fill_coverage(shape, c, FillRule::NonZero);
+    }
+
+    void PNGImage::draw_polygon_aa(const Point *points, size_t count, const Color &c, FillRule rule)
+    {
+        std::vector<Vec> v;
+        for (size_t i = 0; i < count; i++)
+        {
+            Vec q = center_of(points[i]);
+            if (v.empty() || q.x != v.back().x || q.y != v.back().y)
+            {
+                v.push_back(q);
+            }
+        }
+        while (v.size() > 1 && v.front().x == v.back().x && v.front().y == v.back().y)
+        {
+            v.pop_back();
+        }
+        double area = 0;
+        for (size_t i = 0; i < v.size(); i++)
+        {
+            const Vec &a = v[i];
+            const Vec &b = v[(i + 1) % v.size()];
+            area += a.x * b.y - b.x * a.y;
+        }
+        if (v.size() < 3 || area == 0)
+        {
+            // Degenerate polygons are drawn as their outline.
+            for (size_t i = 0; i < count; i++)
+            {
+                draw_line_aa(points[i], points[(i + 1) % count], c);
+            }
+            return;
+        }
+        // Move every edge outwards by half a pixel; each vertex moves
+        // along the bisector of its edges (a miter join), limited to
+        // 2 pixels for very sharp corners.
+        const double side = area > 0 ? 0.5 : -0.5;
+        std::vector<Vec> normals(v.size());
+        for (size_t i = 0; i < v.size(); i++)
+        {
+            const Vec &a = v[i];
+            const Vec &b = v[(i + 1) % v.size()];
+            double dx = b.x - a.x, dy = b.y - a.y;
+            double len = std::sqrt(dx * dx + dy * dy);
+            normals[i] = {side * dy / len, -side * dx / len};
+        }
+        std::vector<Vec> grown(v.size());
+        for (size_t i = 0; i < v.size(); i++)
+        {
+            const Vec &n0 = normals[(i + v.size() - 1) % v.size()];
+            const Vec &n1 = normals[i];
+            // n0 and n1 have length 0.5, so this is 1 + cos(angle).
+            double k = 1.0 + 4.0 * (n0.x * n1.x + n0.y * n1.y);
+            Vec m = {n0.x + n1.x, n0.y + n1.y};
+            double scale = k > 1e-6 ? 1.0 / k : 0.0;
+            double m_len = std::sqrt(m.x * m.x + m.y * m.y) * scale;
+            if (scale == 0.0 || m_len > 2.0)
+            {
+                // Too sharp: clamp the miter, or use the edge normal
+                // when the edges fold back on each other.
+                if (m.x == 0 && m.y == 0)
+                {
+                    m = n1;
+                }
+                double mm = std::sqrt(m.x * m.x + m.y * m.y);
+                scale = 2.0 / mm;
             }
-            dx = x0 - x1;
-            x0 = x1;
-            draw_line(center.translate({-x0, -y}),
-                      center.translate({+x0, -y}),
-                      fill);
-            draw_line(center.translate({-x0, +y}),
-                      center.translate({+x0, +y}),
-                      fill);
+            grown[i] = {v[i].x + m.x * scale, v[i].y + m.y * scale};
         }
+        CoverageRasterizer shape(0, width_, clip_);
+        add_outline(shape, grown);
+        fill_coverage(shape, c, rule);
     }
 
+    void PNGImage::draw_ellipse_aa(const Point &center, const Point &radius, const Color &fill)
+    {
+        if (radius.x < 0 || radius.y < 0)
+        {
+            return;
+        }
+        Vec c = center_of(center);
+        double rx = radius.x + 0.5, ry = radius.y + 0.5;
+        // Enough segments for the outline to stay within 1/20 of a
+        // pixel from the ellipse.
+        double r = std::max(rx, ry);
+        int n = (int)std::ceil(M_PI / std::acos(1.0 - 0.05 / r));
+        n = std::min(std::max(n, 8), 4096);
+        std::vector<Vec> v(n);
+        for (int i = 0; i < n; i++)
+        {
+            double angle = 2.0 * M_PI * i / n;
+            v[i] = {c.x + rx * std::cos(angle), c.y + ry * std::sin(angle)};
+        }
+        CoverageRasterizer shape(0, width_, clip_);
+        add_outline(shape, v);
+        fill_coverage(shape, fill, FillRule::NonZero);
+    }
 }
@@ -3,6 +3,7 @@
 #define __svg_png_image_hpp__
 
 #include "Color.hpp"
+#include "PNGEncoder.hpp"
 #include "Point.hpp"
 
 #include <string>
@@ -10,6 +11,29 @@
 
 namespace svg
 {
+    //! Rule deciding which parts of a polygon are inside of it.
+    enum class FillRule
+    {
+        //! Inside if a ray from the point crosses the outline an odd number of times.
+        EvenOdd,
+        //! Inside if the outline winds around the point a nonzero number of times.
+        NonZero
+    };
+
+    //! Layout of the pixels of an image in memory.
+    enum class PixelFormat
+    {
+        //! 3 bytes per pixel: red, green and blue.
+        RGB8,
+        //! 4 bytes per pixel: red, green, blue and alpha (opacity).
+        RGBA8,
+        //! 4 bytes per pixel: red, green, blue and an unused byte.
+        //! Pixels are 4-byte aligned, and saved as RGB.
+        RGBX8
+    };
+
+    class CoverageRasterizer;
+
     //! PNG image.
     class PNGImage
     {
@@ -22,6 +46,35 @@ namespace svg
         //! @param w Image width.
         //! @param h Image height.
         PNGImage(int w, int h);
+        //! Constructor of blank image with a given background color.
+        //! @param w Image width.
+        //! @param h Image height.
+        //! @param background Initial color of all pixels (opaque).
+        //! @param format Layout of the pixels.
+        PNGImage(int w, int h, const Color &background,
+                 PixelFormat format = PixelFormat::RGB8);
+        //! Constructor of a band of rows of a blank image.
+        //! Only the rows of the band are stored, and they are the
+        //! clipping region, so shapes of the whole image can be drawn
+        //! on it one band at a time.
+        //! @param w Image width.
+        //! @param h Image height.
+        //! @param y0 First row of the band.
+        //! @param y1 Row one past the end of the band.
+        //! @param background Initial color of the pixels of the band (opaque).
+        //! @param format Layout of the pixels.
+        PNGImage(int w, int h, int y0, int y1, const Color &background,
+                 PixelFormat format = PixelFormat::RGB8);
+        //! Constructor of a view on a region of another image.
+        //! The view shares the pixels of the image, and drawing
+        //! through it only changes pixels inside of the region.
+        //! @param image Viewed image, which must outlive the view.
+        //! @param region Region of the image that may be drawn.
+        PNGImage(PNGImage &image, const BBox &region);
+        //! Images own their pixels, so they are not copyable.
+        PNGImage(const PNGImage &) = delete;
+        //! Images own their pixels, so they are not assignable.
+        PNGImage &operator=(const PNGImage &) = delete;
         //! Destructor.
         ~PNGImage();
         //! Get image width.
@@ -30,7 +83,22 @@ namespace svg
         //! Get image height.
         //! @return The image height.
         int height() const;
+        //! Get the layout of the pixels.
+        //! @return The pixel format.
+        PixelFormat format() const;
+        //! Get the size of a pixel.
+        //! @return Bytes per pixel (3 or 4).
+        int bytes_per_pixel() const;
+        //! Get the distance between rows.
+        //! @return Bytes per row.
+        size_t stride() const;
+        //! Get the region that drawing operations may change.
+        //! It covers the whole image, except for views and bands.
+        //! @return The clipping region.
+        const BBox &clip() const;
         //! Get mutable reference to image pixel.
+        //! The color components come first in every pixel format,
+        //! so the reference covers them (but not the alpha byte).
         //! @param x X position
         //! @param y Y position.
         //! @return Reference to pixel.
@@ -40,18 +108,101 @@ namespace svg
         //! @param y Y position.
         //! @return Reference to pixel.
         Color at(int x, int y) const;
+        //! Get the alpha (opacity) of a pixel.
+        //! @param x X position
+        //! @param y Y position.
+        //! @return Alpha value, always 255 for formats without alpha.
+        rgb_value alpha(int x, int y) const;
+        //! Get pointer to the first byte of a row.
+        //! Pixels of a row are stored contiguously, so pixel
+        //! (x, y) starts at row(y) + x * bytes_per_pixel(), and so
+        //! are the rows, one stride apart.
+        //! @param y Y position, of a stored row.
+        //! @return Pointer to the row bytes.
+        unsigned char *row(int y);
+        //! Get const pointer to the first byte of a row.
+        //! @param y Y position.
+        //! @return Pointer to the row bytes.
+        const unsigned char *row(int y) const;
         //! Save to output file.
         //! @param png_file_name Output file name.
-        void save(const std::string &png_file_name) const;
+        //! @param options Encoder options.
+        //! @throws std::runtime_error if the file cannot be written.
+        //! The image must not be a band.
+        void save(const std::string &png_file_name, const PNGOptions &options = PNGOptions()) const;
         //! Draw a line defined by 2 points.
         //! @param a First point.
         //! @param b Second point.
         //! @param c Color to use for the line.
         void draw_line(const Point &a, const Point &b, const Color &c);
+        //! Draw connected line segments.
+        //! Each vertex shared by two segments is set only once.
+        //! @param points Points defining the segments.
+        //! @param count Number of points.
+        //! @param c Color to use for the lines.
+        //! @param closed Whether to join the last point to the first one.
+        void draw_polyline(const Point *points, size_t count, const Color &c, bool closed = false);
+        //! Enable or disable anti-aliasing (disabled by default).
+        //! When enabled, lines, polygons and ellipses blend their
+        //! color into each pixel in proportion to the area of the
+        //! pixel they cover, instead of setting whole pixels.
+        //! @param on Whether to enable anti-aliasing.
+        void set_antialias(bool on);
+        //! Check if anti-aliasing is enabled.
+        //! @return true if enabled.
+        bool antialias() const;
+        //! Get the pixels a shape may change, in the clipping region.
+        //! Anti-aliased shapes reach up to 2 pixels out of their
+        //! bounds (the miter limit of grown polygon corners).
+        //! @param box Bounds of the shape.
+        //! @return Box of the pixels, empty if the shape is not visible.
+        BBox drawn_box(const BBox &box) const;
+        //! Attach an occlusion mask, making the image draw back to front.
+        //! Shapes must then be drawn in reverse order: a pixel is only
+        //! set if its mask byte is zero, and then the byte is set, so the
+        //! first shape setting a pixel (the topmost one) wins, as the last
+        //! one does when drawing front to back. Blending does not commute
+        //! this way, so the mask must not be used with anti-aliasing.
+        //! @param mask One byte per pixel of the stored rows of the image,
+        //! row by row, or nullptr to draw front to back again.
+        void set_occlusion_mask(unsigned char *mask);
+        //! Check if shapes must be drawn back to front.
+        //! @return true if an occlusion mask is attached.
+        bool back_to_front() const;
+        //! Start drawing a new shape, when drawing back to front. Pixels
+        //! set by the shapes drawn before are occluded for it, while the
+        //! pixels it sets more than once (such as its outline over its
+        //! fill) are not counted as occluded pixels.
+        void begin_shape();
+        //! Check if all pixels of a box are already set, when drawing
+        //! back to front; shapes inside of it need not be drawn.
+        //! @param box Box to check, clipped to the clipping region.
+        //! @return true if no pixel of the box can change.
+        bool occluded(const BBox &box) const;
+        //! Get the number of pixel writes skipped because the pixels
+        //! were already set by earlier shapes, when drawing back to front.
+        //! @return Number of skipped pixel writes.
+        unsigned long long occluded_pixels() const;
+        //! Set all pixels in the clipping region to one color.
+        //! @param c Color to use for the pixels.
+        //! @param alpha Opacity of the pixels, for formats with alpha.
+        void clear(const Color &c, rgb_value alpha = 255);
+        //! Fill a horizontal span of pixels.
+        //! Pixels in [x0, x1) on row y are set; the span is
+        //! clipped to the clipping region, so it may lie partially
+        //! or completely outside of the image.
+        //! @param x0 First X position of the span.
+        //! @param x1 X position one past the end of the span.
+        //! @param y Y position of the span.
+        //! @param c Color to use for the span.
+        void fill_span(int x0, int x1, int y, const Color &c);
         //! Draw a polygon.
-        //! @param points Vector of points defining the polygon.
+        //! @param points Points defining the polygon.
+        //! @param count Number of points.
         //! @param fill Color to use for the polygon fill.
-        void draw_polygon(const std::vector<Point> &points, const Color &fill);
+        //! @param rule Fill rule for self-intersecting outlines.
+        void draw_polygon(const Point *points, size_t count, const Color &fill,
+                          FillRule rule = FillRule::NonZero);
         //! Draw an ellipse.
         //! @param center Coordinates for the ellipse center.
         //! @param radius Radius in X and Y axis.
@@ -60,12 +211,111 @@ namespace svg
         void draw_ellipse(const Point &center, const Point &radius, const Color &fill);
 
     private:
+        //! Set a pixel if it lies in the clipping region.
+        //! @param x X position
+        //! @param y Y position.
+        //! @param c Color to use for the pixel.
+        void plot(int x, int y, const Color &c);
+        //! Draw a line, optionally leaving out its first pixel.
+        //! Horizontal, vertical and diagonal lines are filled directly;
+        //! other lines are drawn as runs of pixels, one per step of
+        //! their minor axis.
+        //! @param a First point.
+        //! @param b Second point.
+        //! @param c Color to use for the line.
+        //! @param include_first Whether to set the pixel of point a.
+        void draw_segment(const Point &a, const Point &b, const Color &c, bool include_first);
+        //! Fill a vertical span of pixels, clipped like fill_span.
+        //! @param x X position of the span.
+        //! @param y0 First Y position of the span.
+        //! @param y1 Y position one past the end of the span.
+        //! @param c Color to use for the span.
+        void fill_column(int x, int y0, int y1, const Color &c);
+        //! Get the mask bytes of a row.
+        //! @param y Y position.
+        //! @return Pointer to the row mask bytes.
+        unsigned char *mask_row(int y);
+        //! Count the pixels of each row of the clipping region left
+        //! unset by the occlusion mask.
+        void count_open_pixels();
+        //! Set the pixels of a span that are not occluded yet.
+        //! @param x0 First X position of the span (clipped).
+        //! @param x1 X position one past the end of the span (clipped).
+        //! @param y Y position of the span (clipped).
+        //! @param c Color to use for the span.
+        void fill_span_occluded(int x0, int x1, int y, const Color &c);
+        //! Write a span of pixels, which must lie in the clipping region.
+        //! @param x0 First X position of the span.
+        //! @param x1 X position one past the end of the span.
+        //! @param y Y position of the span.
+        //! @param c Color to use for the span.
+        void write_span(int x0, int x1, int y, const Color &c);
+        //! Get the half-widths of the rows of an ellipse, from the
+        //! center row outward. The table is kept for the next ellipse
+        //! with the same radius, and only extended as far as needed.
+        //! @param radius Radius in X and Y axis.
+        //! @param rows Last row needed.
+        //! @return Half-widths of rows 0 to at least rows.
+        const std::vector<int> &ellipse_half_widths(const Point &radius, int rows);
+        //! Blend a color into a horizontal span of pixels.
+        //! @param x0 First X position of the span.
+        //! @param x1 X position one past the end of the span.
+        //! @param y Y position of the span.
+        //! @param c Color to blend.
+        //! @param coverage Weight of the color, in [0, 1].
+        void blend_span(int x0, int x1, int y, const Color &c, float coverage);
+        //! Blend a color into the pixels covered by a shape.
+        //! @param shape Rasterizer holding the shape outline.
+        //! @param c Color to blend.
+        //! @param rule Fill rule for the shape.
+        void fill_coverage(CoverageRasterizer &shape, const Color &c, FillRule rule);
+        //! Anti-aliased version of draw_line.
+        void draw_line_aa(const Point &a, const Point &b, const Color &c);
+        //! Anti-aliased version of draw_polygon.
+        void draw_polygon_aa(const Point *points, size_t count, const Color &fill, FillRule rule);
+        //! Anti-aliased version of draw_ellipse.
+        void draw_ellipse_aa(const Point &center, const Point &radius, const Color &fill);
+
         //! Width.
         int width_;
         //! Height.
         int height_;
-        //! Pixels.
-        Color *pixels_;
+        //! Pixel layout.
+        PixelFormat format_;
+        //! Bytes per pixel.
+        int bpp_;
+        //! Pixels of the stored rows.
+        unsigned char *pixels_;
+        //! First stored row (0 except for bands).
+        int first_row_;
+        //! Number of stored rows.
+        int stored_rows_;
+        //! Region that drawing operations may change.
+        BBox clip_;
+        //! Whether the pixels are owned (false for views).
+        bool owner_;
+        //! Whether anti-aliasing is enabled.
+        bool antialias_;
+        //! Occlusion mask, or nullptr when drawing front to back.
+        unsigned char *mask_;
+        //! Pixels not set yet in each row of the clipping region.
+        std::vector<int> open_pixels_;
+        //! Pixel writes skipped by the occlusion mask.
+        unsigned long long occluded_pixels_;
+        //! Mask byte of the pixels set by the current shape (see
+        //! begin_shape); the pixels set by earlier shapes have other
+        //! nonzero bytes.
+        unsigned char shape_mark_;
+        //! Row half-widths of the last ellipse radius drawn.
+        struct EllipseSpans
+        {
+            //! Radius in X and Y axis.
+            Point radius;
+            //! Half-width of each row, from the center row outward.
+            std::vector<int> widths;
+            //! Decrease of the half-width at the last row.
+            int dx;
+        } ellipse_spans_;
     };
 }
 
@@ -1,5 +1,6 @@
 //! @file point.cpp
 #include <cmath>
+#include <algorithm>
 #include "Point.hpp"
 
 namespace svg
@@ -27,4 +28,29 @@ namespace svg
                 origin.y + (y - origin.y) * v};
     }
 
+    bool BBox::empty() const
+    {
+        return max.x <= min.x || max.y <= min.y;
+    }
+
+    BBox BBox::intersect(const BBox &b) const
+    {
+        return {{std::max(min.x, b.min.x), std::max(min.y, b.min.y)},
+                {std::min(max.x, b.max.x), std::min(max.y, b.max.y)}};
+    }
+
+    BBox BBox::unite(const BBox &b) const
+    {
+        if (empty())
+        {
+            return b;
+        }
+        if (b.empty())
+        {
+            return *this;
+        }
+        return {{std::min(min.x, b.min.x), std::min(min.y, b.min.y)},
+                {std::max(max.x, b.max.x), std::max(max.y, b.max.y)}};
+    }
+
 }
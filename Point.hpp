@@ -27,5 +27,29 @@ namespace svg
         //! @return Scaling result.
         Point scale(const Point &origin, int v) const;
     };
+
+    //! Axis-aligned box of pixels.
+    //! The box covers the pixels with min.x <= x < max.x
+    //! and min.y <= y < max.y, so it is empty when either
+    //! max coordinate does not exceed the min one.
+    struct BBox
+    {
+        //! Top left corner (inclusive).
+        Point min;
+        //! Bottom right corner (exclusive).
+        Point max;
+
+        //! Check if the box covers no pixels.
+        //! @return true if the box is empty.
+        bool empty() const;
+        //! Intersect two boxes.
+        //! @param b The other box.
+        //! @return Box with the pixels covered by both boxes.
+        BBox intersect(const BBox &b) const;
+        //! Unite two boxes.
+        //! @param b The other box.
+        //! @return Smallest box covering the pixels of both boxes.
+        BBox unite(const BBox &b) const;
+    };
 }
 #endif
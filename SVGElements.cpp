@@ -1,320 +1,199 @@
 #include "SVGElements.hpp"
+#include <vector>
 
 namespace svg
 {
-    SVGElement::SVGElement() {}
+    SVGElement::SVGElement() : transform_(nullptr), parent_(nullptr) {}
     SVGElement::~SVGElement() {}
-
-    Ellipse::Ellipse(const Color &fill,
-                     const Point &center,
-                     const Point &radius)
-        : fill(fill), center(center), radius(radius)
+    void SVGElement::draw(PNGImage &img) const
     {
+        DisplayList list;
+        compile(list);
+        list.draw(img);
     }
-    Ellipse::~Ellipse() {}
-    void Ellipse::draw(PNGImage &img) const
+    void SVGElement::compile(DisplayList &list) const
     {
-        img.draw_ellipse(center, radius, fill);
+        flatten(list, Transform());
     }
-    void svg::Ellipse::translate(Point &t)
+    void SVGElement::set_transform(const Transform *transform)
     {
-        center = center.translate(t);
+        transform_ = transform;
     }
-    void svg::Ellipse::rotate(const Point &origin, int degrees)
+    void SVGElement::set_parent(const SVGElement *parent)
     {
-        center = center.rotate(origin, degrees);
+        parent_ = parent;
     }
-    void svg::Ellipse::scale(const Point &origin, int v)
+    const SVGElement *SVGElement::parent() const
     {
-        // Calculate the distance from the center to the scaling origin
-        Point dist;
-        dist.x = center.x - origin.x;
-        dist.y = center.y - origin.y;
-        // Scale the distance
-        dist.x = dist.x * v;
-        dist.y = dist.y * v;
-        // Move the center to the new location
-        center.x = origin.x + dist.x;
-        center.y = origin.y + dist.y;
-        // Scale the radius
-        radius.x = radius.x * v;
-        radius.y = radius.y * v;
+        return parent_;
     }
-    Ellipse *Ellipse::clone() const
+    Transform SVGElement::world(const Transform &outer) const
     {
-        return new Ellipse(*this);
+        return transform_ != nullptr ? transform_->then(outer) : outer;
     }
-
-    Circle::Circle(const Color &fill,
-                   const Point &center,
-                   const int &radius)
-        : Ellipse(fill, center, Point{radius, radius}), radius(radius)
+    bool SVGElement::draws(const SVGElement *element) const
     {
+        return element == this;
     }
-    Circle::~Circle() {}
-    void Circle::draw(PNGImage &img) const
-    {
-        img.draw_ellipse(center, Point{radius, radius}, fill);
-    }
-    void svg::Circle::translate(Point &t)
+
+    Ellipse::Ellipse(const Color &fill,
+                     const Point &center,
+                     const Point &radius)
+        : fill(fill), center(center), radius(radius)
     {
-        center = center.translate(t);
     }
-    void svg::Circle::rotate(const Point &origin, int degrees)
+    Ellipse::~Ellipse() {}
+    void Ellipse::flatten(DisplayList &list, const Transform &outer) const
     {
-        center = center.rotate(origin, degrees);
+        list.add_ellipse(fill, center, radius, world(outer));
     }
-    void svg::Circle::scale(const Point &origin, int v)
+
+    Circle::Circle(const Color &fill,
+                   const Point &center,
+                   const int &radius)
+        : Ellipse(fill, center, Point{radius, radius}), radius(radius)
     {
-        // Calculate the distance from the center to the scaling origin
-        Point dist;
-        dist.x = center.x - origin.x;
-        dist.y = center.y - origin.y;
-        // Scale the distance
-        dist.x = dist.x * v;
-        dist.y = dist.y * v;
-        // Move the center to the new location
-        center.x = origin.x + dist.x;
-        center.y = origin.y + dist.y;
-        // Scale the radius
-        radius = radius * v;
     }
-    Circle *Circle::clone() const
+    Circle::~Circle() {}
+    void Circle::flatten(DisplayList &list, const Transform &outer) const
     {
-        return new Circle(*this);
+        list.add_ellipse(fill, center, Point{radius, radius}, world(outer));
     }
 
     Polygon::Polygon(const Color &fill,
-                     const std::vector<Point> &points)
-        : fill(fill), points(points)
+                     Span<Point> points,
+                     FillRule rule)
+        : fill(fill), points(points), rule(rule)
     {
     }
     Polygon::~Polygon() {}
-    void Polygon::draw(PNGImage &img) const
-    {
-        img.draw_polygon(points, fill);
-    }
-    void svg::Polygon::translate(Point &t)
-    {
-        for (auto &point : points)
-        {
-            point = point.translate(t);
-        }
-    }
-    void svg::Polygon::rotate(const Point &origin, int degrees)
+    void Polygon::flatten(DisplayList &list, const Transform &outer) const
     {
-        for (auto &point : points)
-        {
-            point = point.rotate(origin, degrees);
-        }
-    }
-    void svg::Polygon::scale(const Point &origin, int v)
-    {
-        for (Point &point : points)
-        {
-            // Calculate the distance from the point to the scaling origin
-            Point dist;
-            dist.x = point.x - origin.x;
-            dist.y = point.y - origin.y;
-            // Scale the distance
-            dist.x *= v;
-            dist.y *= v;
-            // Move the point to the new location
-            point.x = origin.x + dist.x;
-            point.y = origin.y + dist.y;
-        }
-    }
-    Polygon *Polygon::clone() const
-    {
-        return new Polygon(*this);
+        list.add_polygon(fill, points.data(), points.size(), rule, world(outer));
     }
 
     Rect::Rect(const Color &fill,
                const Point &top_left,
                const Point &bottom_right)
-        : Polygon(fill, {top_left, Point{bottom_right.x, top_left.y}, bottom_right, Point{top_left.x, bottom_right.y}})
-    {
-    }
-    Rect::~Rect() {}
-    void Rect::draw(PNGImage &img) const
-    {
-        img.draw_polygon(points, fill);
-    }
-    void svg::Rect::translate(Point &t)
-    {
-        for (auto &point : points)
-        {
-            point = point.translate(t);
-        }
-    }
-    void svg::Rect::rotate(const Point &origin, int degrees)
+        : Polygon(fill, {corners, 4}),
+          corners{top_left, Point{bottom_right.x, top_left.y}, bottom_right, Point{top_left.x, bottom_right.y}}
     {
-        for (auto &point : points)
-        {
-            point = point.rotate(origin, degrees);
-        }
     }
-    void svg::Rect::scale(const Point &origin, int v)
+    Rect::Rect(const Rect &other)
+        : Polygon(other),
+          corners{other.corners[0], other.corners[1], other.corners[2], other.corners[3]}
     {
-        for (Point &point : points)
-        {
-            // Calculate the distance from the point to the scaling origin
-            Point dist;
-            dist.x = point.x - origin.x;
-            dist.y = point.y - origin.y;
-            // Scale the distance
-            dist.x *= v;
-            dist.y *= v;
-            // Move the point to the new location
-            point.x = origin.x + dist.x;
-            point.y = origin.y + dist.y;
-        }
+        points = {corners, 4};
     }
-    Rect *Rect::clone() const
+    Rect::~Rect() {}
+    void Rect::flatten(DisplayList &list, const Transform &outer) const
     {
-        return new Rect(*this);
+        list.add_polygon(fill, points.data(), points.size(), FillRule::NonZero, world(outer));
     }
 
     Polyline::Polyline(const Color &stroke,
-                       const std::vector<Point> &points)
+                       Span<Point> points)
         : stroke(stroke), points(points)
     {
     }
     Polyline::~Polyline() {}
-    void Polyline::draw(PNGImage &img) const
-    {
-        for (size_t i = 0; i < points.size() - 1; ++i)
-        {
-            img.draw_line(points[i], points[i + 1], stroke);
-        }
-    }
-    void svg::Polyline::translate(Point &t)
-    {
-        for (auto &point : points)
-        {
-            point = point.translate(t);
-        }
-    }
-    void svg::Polyline::rotate(const Point &origin, int degrees)
-    {
-        for (auto &point : points)
-        {
-            point = point.rotate(origin, degrees);
-        }
-    }
-    void svg::Polyline::scale(const Point &origin, int v)
-    {
-        for (Point &point : points)
-        {
-            // Calculate the distance from the point to the scaling origin
-            Point dist;
-            dist.x = point.x - origin.x;
-            dist.y = point.y - origin.y;
-            // Scale the distance
-            dist.x *= v;
-            dist.y *= v;
-            // Move the point to the new location
-            point.x = origin.x + dist.x;
-            point.y = origin.y + dist.y;
-        }
-    }
-    Polyline *Polyline::clone() const
+    void Polyline::flatten(DisplayList &list, const Transform &outer) const
     {
-        return new Polyline(*this);
+        list.add_polyline(stroke, points.data(), points.size(), world(outer));
     }
 
     Line::Line(const Color &stroke,
                const Point &start,
                const Point &end)
-        : Polyline(stroke, {start, end}), start(start), end(end)
+        : Polyline(stroke, {nullptr, 0}), start(start), end(end)
     {
     }
     Line::~Line() {}
-    void Line::draw(PNGImage &img) const
-    {
-        img.draw_line(start, end, stroke);
-    }
-    void svg::Line::translate(Point &t)
-    {
-        start = start.translate(t);
-        end = end.translate(t);
-    }
-    void svg::Line::rotate(const Point &origin, int degrees)
-    {
-        start = start.rotate(origin, degrees);
-        end = end.rotate(origin, degrees);
-    }
-    void svg::Line::scale(const Point &origin, int v)
-    {
-        // Calculate the distance from the start point to the scaling origin
-        Point dist;
-        dist.x = start.x - origin.x;
-        dist.y = start.y - origin.y;
-        // Scale the distance
-        dist.x *= v;
-        dist.y *= v;
-        // Move the start point to the new location
-        start.x = origin.x + dist.x;
-        start.y = origin.y + dist.y;
-        // Do the same for the end point
-        dist.x = end.x - origin.x;
-        dist.y = end.y - origin.y;
-        dist.x *= v;
-        dist.y *= v;
-        end.x = origin.x + dist.x;
-        end.y = origin.y + dist.y;
-    }
-    Line *Line::clone() const
+    void Line::flatten(DisplayList &list, const Transform &outer) const
     {
-        return new Line(*this);
+        const Point ends[2] = {start, end};
+        list.add_polyline(stroke, ends, 2, world(outer));
     }
 
-    Group::Group(const std::vector<SVGElement *> &elements)
+    Group::Group(Span<SVGElement *> elements)
         : elements(elements)
     {
-    }
-    Group::~Group() 
-    {
-        for (auto &element : elements)
+        for (SVGElement *element : elements)
         {
-            delete element;
+            element->set_parent(this);
         }
     }
-    void Group::draw(PNGImage &img) const
+    Group::~Group() {}
+    void Group::flatten(DisplayList &list, const Transform &outer) const
     {
+        Transform transform = world(outer);
         for (const auto &element : elements)
         {
-            element->draw(img);
+            element->flatten(list, transform);
         }
     }
-    void svg::Group::translate(Point &t)
+    bool Group::draws(const SVGElement *element) const
     {
-        for (auto &element : elements)
+        if (element == this)
         {
-            element->translate(t);
+            return true;
         }
+        for (const auto &child : elements)
+        {
+            if (child->draws(element))
+            {
+                return true;
+            }
+        }
+        return false;
     }
-    void svg::Group::rotate(const Point &origin, int degrees)
+
+    Use::Use(const SVGElement *element)
+        : element(element), top(element)
     {
-        for (auto &element : elements)
+        while (top != nullptr && top->parent() != nullptr)
         {
-            element->rotate(origin, degrees);
+            top = top->parent();
         }
     }
-    void svg::Group::scale(const Point &origin, int v)
+    Use::~Use() {}
+    void Use::resolve(const SVGElement *element, bool read_before)
     {
-        for (auto &element : elements)
+        this->element = element;
+        top = element;
+        while (read_before && top->parent() != nullptr)
         {
-            element->scale(origin, v);
+            top = top->parent();
         }
     }
-    Group *Group::clone() const
+    bool Use::resolved() const
     {
-        std::vector<SVGElement *> cloned_elements;
-        for (const auto &element : elements)
+        return element != nullptr;
+    }
+    void Use::flatten(DisplayList &list, const Transform &outer) const
+    {
+        if (element == nullptr)
         {
-            cloned_elements.push_back(element->clone());
+            return;
         }
-        return new Group(cloned_elements);
+        // The groups between the shared element and top were read before
+        // the use element, so their transformations come first, innermost
+        // first; groups added around top later on are ignored.
+        std::vector<const SVGElement *> groups;
+        for (const SVGElement *group = element; group != top;)
+        {
+            group = group->parent();
+            groups.push_back(group);
+        }
+        Transform transform = world(outer);
+        for (size_t i = groups.size(); i-- > 0;)
+        {
+            transform = groups[i]->world(transform);
+        }
+        element->flatten(list, transform);
+    }
+    bool Use::draws(const SVGElement *element) const
+    {
+        return element == this || (this->element != nullptr && this->element->draws(element));
     }
-}
\ No newline at end of file
+}
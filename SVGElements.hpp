@@ -5,6 +5,11 @@
 #include "Color.hpp"
 #include "Point.hpp"
 #include "PNGImage.hpp"
+#include "DisplayList.hpp"
+#include "Transform.hpp"
+#include "Arena.hpp"
+
+#include <functional>
 
 namespace svg
 {
@@ -12,15 +17,15 @@ namespace svg
     //! @brief Abstract class that represents an SVG element
     //! This class is the base
     //! class for all SVG elements. It provides
-    //! the interface for drawing, translating,
-    //! rotating, and scaling an SVG element.
-    //! The class also provides a clone method
-    //! that creates a deep copy of the object.
+    //! the interface for drawing an SVG element,
+    //! and holds its transformation, which is
+    //! only applied to the points of the element
+    //! when it is flattened into a display list.
     //! The class is abstract and cannot be
     //! instantiated.
     //! @note The class is part of the svg namespace.
     //! @see svg::Ellipse, svg::Circle, svg::Polygon,
-    //! svg::Rect, svg::Polyline, svg::Line, svg::Group
+    //! svg::Rect, svg::Polyline, svg::Line, svg::Group, svg::Use
     class SVGElement
     {
     public:
@@ -30,40 +35,174 @@ namespace svg
         virtual ~SVGElement();
         //! Draw the SVG element on the PNG image
         //! @param img PNG image
-        virtual void draw(PNGImage &img) const = 0;
-        //! Translate the SVG element by a given vector
-        //! @param t Translation vector
-        virtual void translate(Point &t) = 0;
-        //! Rotate the SVG element around a given point
-        //! @param origin Point to rotate around
-        //! @param degrees Degrees to rotate
-        virtual void rotate(const Point &origin, int degrees) = 0;
-        //! Scale the SVG element around a given point
-        //! @param origin Point to scale around
-        //! @param v Scale factor
-        virtual void scale(const Point &origin, int v) = 0;
-        //! Create a deep copy of the SVG element
-        //! @return Pointer to the cloned SVG element
-        virtual SVGElement *clone() const = 0;
+        void draw(PNGImage &img) const;
+        //! Append the commands drawing the SVG element to a display list
+        //! @param list Display list
+        void compile(DisplayList &list) const;
+        //! Append the commands drawing the SVG element to a display list,
+        //! transformed by the transformation of the element and then
+        //! by the transformation of the groups containing it
+        //! @param list Display list
+        //! @param outer Transformation of the groups containing the element
+        virtual void flatten(DisplayList &list, const Transform &outer) const = 0;
+        //! Set the transformation of the SVG element
+        //! @param transform Transformation, stored in an arena or another
+        //! storage outliving the element, or nullptr for none
+        void set_transform(const Transform *transform);
+        //! Set the group containing the SVG element
+        //! @param parent The group
+        void set_parent(const SVGElement *parent);
+        //! Get the group containing the SVG element
+        //! @return The group, or nullptr if the element is not in a group
+        const SVGElement *parent() const;
+        //! Compose the transformation of the SVG element with another one
+        //! @param outer Transformation applied after that of the element
+        //! @return The composed transformation
+        Transform world(const Transform &outer) const;
+        //! Check if drawing the SVG element draws another one
+        //! @param element The other element
+        //! @return true if element is this element, one of the elements
+        //! of this group, or the element shared by this use element
+        virtual bool draws(const SVGElement *element) const;
+    private:
+        //! Transformation, nullptr for the identity
+        const Transform *transform_;
+        //! Group containing the element
+        const SVGElement *parent_;
     };
     //! Reads an SVG file and creates the dimensions and elements
     //! @param svg_file SVG file name
     //! @param dimensions Dimensions of the SVG file
     //! @param svg_elements Vector of SVG elements
+    //! @param arena Arena owning the SVG elements and their points
+    //! @param threads Number of threads reading the top-level elements of
+    //! large files, 0 for one per hardware thread
     void readSVG(const std::string &svg_file,
                  Point &dimensions,
-                 std::vector<SVGElement *> &svg_elements);
+                 std::vector<SVGElement *> &svg_elements,
+                 Arena &arena,
+                 unsigned threads = 1);
+    //! Reads an SVG document from memory and creates the dimensions and elements
+    //! The elements do not refer to the document, which can be released
+    //! once it is read.
+    //! @param svg_data First byte of the document
+    //! @param svg_size Number of bytes of the document
+    //! @param dimensions Dimensions of the SVG document
+    //! @param svg_elements Vector of SVG elements
+    //! @param arena Arena owning the SVG elements and their points
+    //! @param threads Number of threads reading the top-level elements of
+    //! large documents, 0 for one per hardware thread
+    void readSVG(const char *svg_data,
+                 size_t svg_size,
+                 Point &dimensions,
+                 std::vector<SVGElement *> &svg_elements,
+                 Arena &arena,
+                 unsigned threads = 1);
+    //! @struct ConvertOptions
+    //! @brief Options for converting SVG files to PNG files
+    struct ConvertOptions
+    {
+        //! Default constructor, setting the default options
+        ConvertOptions();
+        //! Number of reading and rendering threads, 0 for one per hardware thread
+        unsigned threads;
+        //! Width and height of the tiles that are rendered in parallel
+        int tile_size;
+        //! Whether to draw anti-aliased shapes (see PNGImage::set_antialias)
+        bool antialias;
+        //! Pixel format of the image; with RGBA8 the background is
+        //! transparent instead of white
+        PixelFormat format;
+        //! Whether to draw back to front, skipping the pixels hidden by
+        //! later shapes (see PNGImage::set_occlusion_mask); not used
+        //! with anti-aliasing
+        bool occlusion_culling;
+        //! Compression level of the PNG file, from 0 to 9 (see PNGOptions)
+        int compression_level;
+        //! Filter of the rows of the PNG file (see PNGFilter)
+        PNGFilter filter;
+        //! Rows of the bands the image is drawn and written in, one band
+        //! at a time (see render_bands); 0 to draw the whole image at
+        //! once, unless it takes more than 256 MiB
+        int band_height;
+    };
+    //! @struct RenderStats
+    //! @brief Work saved while rendering
+    struct RenderStats
+    {
+        //! Default constructor, setting the counters to zero
+        RenderStats();
+        //! Pixel writes skipped because later shapes hide the pixels
+        unsigned long long occluded_pixels;
+        //! Commands not drawn in a tile because they are hidden there
+        size_t culled_elements;
+    };
+    //! Compiles SVG elements into a display list
+    //! @param svg_elements Vector of SVG elements
+    //! @param list Display list to append the commands to
+    void compile(const std::vector<SVGElement *> &svg_elements,
+                 DisplayList &list);
+    //! Draws a display list on a PNG image
+    //! The image is split in tiles, each tile gets the commands
+    //! whose bounding box overlaps it, and tiles are drawn in
+    //! parallel. Commands are drawn in order within each tile,
+    //! so the result is the same as drawing them one by one;
+    //! with occlusion culling they are drawn in reverse order instead,
+    //! and a pixel is only set by the topmost command covering it.
+    //! @param list Display list
+    //! @param img PNG image
+    //! @param options Conversion options
+    //! @param stats If not nullptr, set to the work saved by culling
+    void render(const DisplayList &list,
+                PNGImage &img,
+                const ConvertOptions &options,
+                RenderStats *stats = nullptr);
+    //! Gets the rows of the bands an image is drawn in
+    //! @param width Image width
+    //! @param height Image height
+    //! @param options Conversion options
+    //! @return Rows per band (at least 1), the image height to draw it at once
+    int band_rows(int width, int height, const ConvertOptions &options);
+    //! Draws a display list on an image one band of rows at a time,
+    //! so that only one band is in memory
+    //! The commands are binned in the bands their bounding box overlaps,
+    //! and each band is drawn with its commands as render draws an image,
+    //! on a blank band (white, transparent with RGBA8), then handed to a
+    //! function before the next one is drawn.
+    //! @param list Display list
+    //! @param width Image width
+    //! @param height Image height
+    //! @param options Conversion options (see band_rows)
+    //! @param done Function called with each band, from top to bottom
+    //! @param stats If not nullptr, set to the work saved by culling
+    void render_bands(const DisplayList &list,
+                      int width, int height,
+                      const ConvertOptions &options,
+                      const std::function<void(PNGImage &)> &done,
+                      RenderStats *stats = nullptr);
     //! Converts an SVG file to a PNG file
     //! @param svg_file SVG file name
     //! @param png_file PNG file name
+    //! @param options Conversion options
+    //! @param stats If not nullptr, set to the work saved by culling
     void convert(const std::string &svg_file,
-                 const std::string &png_file);
+                 const std::string &png_file,
+                 const ConvertOptions &options = ConvertOptions(),
+                 RenderStats *stats = nullptr);
+    //! Converts an SVG document in memory to a PNG file in memory
+    //! @param svg_data First byte of the SVG document
+    //! @param svg_size Number of bytes of the SVG document
+    //! @param png Bytes of the PNG file, appended to
+    //! @param options Conversion options
+    //! @param stats If not nullptr, set to the work saved by culling
+    void convert(const char *svg_data,
+                 size_t svg_size,
+                 std::vector<unsigned char> &png,
+                 const ConvertOptions &options = ConvertOptions(),
+                 RenderStats *stats = nullptr);
     //! @class Ellipse
     //! @brief Class that represents an SVG ellipse
-    //! The class provides methods for drawing,
-    //! translating, rotating, and scaling the ellipse.
-    //! The class also provides a clone method
-    //! that creates a deep copy of the object.
+    //! The class provides methods for drawing the ellipse.
     class Ellipse : public SVGElement
     {
     public:
@@ -74,23 +213,10 @@ namespace svg
         Ellipse(const Color &fill, const Point &center, const Point &radius);
         //! Destructor
         ~Ellipse();
-        //! Draw the ellipse on the PNG image
-        //! @param img PNG image
-        void draw(PNGImage &img) const override;
-        //! Translate the ellipse by a given vector
-        //! @param t Translation vector
-        void translate(Point &t) override;
-        //! Rotate the ellipse around a given point
-        //! @param origin Point to rotate around
-        //! @param degrees Degrees to rotate
-        void rotate(const Point &origin, int degrees) override;
-        //! Scale the ellipse around a given point
-        //! @param origin Point to scale around
-        //! @param v Scale factor
-        void scale(const Point &origin, int v) override;
-        //! Create a deep copy of the ellipse
-        //! @return Pointer to the cloned ellipse
-        Ellipse* clone() const override;
+        //! Append the commands drawing the ellipse to a display list
+        //! @param list Display list
+        //! @param outer Transformation of the groups containing the ellipse
+        void flatten(DisplayList &list, const Transform &outer) const override;
     protected:
         //! Fill color
         Color fill;
@@ -101,10 +227,7 @@ namespace svg
     };
     //! @class Circle
     //! @brief Class that represents an SVG circle subclass of Ellipse
-    //! The class provides methods for drawing,
-    //! translating, rotating, and scaling the circle.
-    //! The class also provides a clone method
-    //! that creates a deep copy of the object.
+    //! The class provides methods for drawing the circle.
     class Circle : public Ellipse
     {
     public:
@@ -115,71 +238,44 @@ namespace svg
         Circle(const Color &fill, const Point &center, const int &radius);
         //! Destructor
         ~Circle();
-        //! Draw the circle on the PNG image.
-        //! @param img PNG image.
-        void draw(PNGImage &img) const override;
-        //! Translate the circle by a given vector.
-        //! @param t Translation vector.
-        void translate(Point &t) override;
-        //! Rotate the circle around a given point.
-        //! @param origin Point to rotate around.
-        //! @param degrees Degrees to rotate.
-        void rotate(const Point &origin, int degrees) override;
-        //! Scale the circle around a given point.
-        //! @param origin Point to scale around.
-        //! @param v Scale factor.
-        void scale(const Point &origin, int v) override;
-        //! Create a deep copy of the circle.
-        //! @return Pointer to the cloned circle.
-        Circle* clone() const override;
+        //! Append the commands drawing the circle to a display list
+        //! @param list Display list
+        //! @param outer Transformation of the groups containing the circle
+        void flatten(DisplayList &list, const Transform &outer) const override;
     private:
         //! Radius of the circle
         int radius;
     };
     //! @class Polygon
     //! @brief Class that represents an SVG polygon
-    //! The class provides methods for drawing,
-    //! translating, rotating, and scaling the polygon.
-    //! The class also provides a clone method
-    //! that creates a deep copy of the object.
+    //! The class provides methods for drawing the polygon.
     class Polygon : public SVGElement
     {
     public:
         //! Constructor
         //! @param fill Color to use for the polygon fill.
-        //! @param points Vector of points defining the polygon.
-        Polygon(const Color &fill, const std::vector<Point> &points);
+        //! @param points Points defining the polygon, stored in an
+        //! arena or another storage outliving the polygon.
+        //! @param rule Fill rule for self-intersecting outlines.
+        Polygon(const Color &fill, Span<Point> points,
+                FillRule rule = FillRule::NonZero);
         //! Destructor
         ~Polygon();
-        //! Draw the polygon on the PNG image.
-        //! @param img PNG image.
-        void draw(PNGImage &img) const override;
-        //! Translate the polygon by a given vector.
-        //! @param t Translation vector.
-        void translate(Point &t) override;
-        //! Rotate the polygon around a given point
-        //! @param origin Point to rotate around.
-        //! @param degrees Degrees to rotate.
-        void rotate(const Point &origin, int degrees) override;
-        //! Scale the polygon around a given point.
-        //! @param origin Point to scale around.
-        //! @param v Scale factor.
-        void scale(const Point &origin, int v) override;
-        //! Create a deep copy of the polygon.
-        //! @return Pointer to the cloned polygon.
-        Polygon* clone() const override;
+        //! Append the commands drawing the polygon to a display list
+        //! @param list Display list
+        //! @param outer Transformation of the groups containing the polygon
+        void flatten(DisplayList &list, const Transform &outer) const override;
     protected:
         //! Fill Color
         Color fill;
-        //! Vector of points defining the polygon
-        std::vector<Point> points;
+        //! Points defining the polygon
+        Span<Point> points;
+        //! Fill rule
+        FillRule rule;
     };
     //! @class Rect
     //! @brief Class that represents an SVG rectangle subclass of Polygon
-    //! The class provides methods for drawing,
-    //! translating, rotating, and scaling the rectangle.
-    //! The class also provides a clone method
-    //! that creates a deep copy of the object.
+    //! The class provides methods for drawing the rectangle.
     class Rect : public Polygon
     {
     public:
@@ -188,75 +284,45 @@ namespace svg
         //! @param top_left Coordinates for the top left corner.
         //! @param bottom_right Coordinates for the bottom right corner.
         Rect(const Color &fill, const Point &top_left, const Point &bottom_right);
+        //! Copy constructor, making the copy use its own corners
+        //! @param other Rectangle to copy.
+        Rect(const Rect &other);
         //! Destructor
         ~Rect();
-        //! Draw the rectangle on the PNG image.
-        //! @param img PNG image.
-        void draw(PNGImage &img) const override;
-        //! Translate the rectangle by a given vector.
-        //! @param t Translation vector.
-        void translate(Point &t) override;
-        //! Rotate the rectangle around a given point.
-        //! @param origin Point to rotate around.
-        //! @param degrees Degrees to rotate.
-        void rotate(const Point &origin, int degrees) override;
-        //! Scale the rectangle around a given point.
-        //! @param origin Point to scale around.
-        //! @param v Scale factor.
-        void scale(const Point &origin, int v) override;
-        //! Create a deep copy of the rectangle.
-        //! @return Pointer to the cloned rectangle.
-        Rect* clone() const override;
+        //! Append the commands drawing the rectangle to a display list
+        //! @param list Display list
+        //! @param outer Transformation of the groups containing the rectangle
+        void flatten(DisplayList &list, const Transform &outer) const override;
     private:
-        //! Top left corner coordinates
-        Point top_left;
-        //! Bottom right corner coordinates
-        Point bottom_right;
+        //! Corners, which are the points of the polygon
+        Point corners[4];
     };
     //! @class Polyline
     //! @brief Class that represents an SVG polyline
-    //! The class provides methods for drawing,
-    //! translating, rotating, and scaling the polyline.
-    //! The class also provides a clone method
-    //! that creates a deep copy of the object.
+    //! The class provides methods for drawing the polyline.
     class Polyline : public SVGElement
     {
     public:
         //! Constructor
         //! @param stroke Color to use for the polyline stroke.
-        //! @param points Vector of points defining the polyline.
-        Polyline(const Color &stroke, const std::vector<Point> &points);
+        //! @param points Points defining the polyline, stored in an
+        //! arena or another storage outliving the polyline.
+        Polyline(const Color &stroke, Span<Point> points);
         //! Destructor
         ~Polyline();
-        //! Draw the polyline on the PNG image.
-        //! @param img PNG image.
-        void draw(PNGImage &img) const override;
-        //! Translate the polyline by a given vector.
-        //! @param t Translation vector.
-        void translate(Point &t) override;
-        //! Rotate the polyline around a given point.
-        //! @param origin Point to rotate around.
-        //! @param degrees Degrees to rotate.
-        void rotate(const Point &origin, int degrees) override;
-        //! Scale the polyline around a given point.
-        //! @param origin Point to scale around.
-        //! @param v Scale factor.
-        void scale(const Point &origin, int v) override;
-        //! Create a deep copy of the polyline.
-        //! @return Pointer to the cloned polyline.
-        Polyline* clone() const override;
+        //! Append the commands drawing the polyline to a display list
+        //! @param list Display list
+        //! @param outer Transformation of the groups containing the polyline
+        void flatten(DisplayList &list, const Transform &outer) const override;
     protected:
         //! Stroke color
         Color stroke;
-        //! Vector of points defining the polyline
-        std::vector<Point> points;
+        //! Points defining the polyline
+        Span<Point> points;
     };
     //! @class Line
     //! @brief Class that represents an SVG line sublcass of Polyline
-    //! The class provides methods for drawing,
-    //! translating, rotating, and scaling the line.
-    //! The class also provides a clone method
-    //! that creates a deep copy of the object.
+    //! The class provides methods for drawing the line.
     class Line : public Polyline
     {
     public:
@@ -267,23 +333,10 @@ namespace svg
         Line(const Color &stroke, const Point &start, const Point &end);
         //! Destructor
         ~Line();
-        //! Draw the line on the PNG image.
-        //! @param img PNG image.
-        void draw(PNGImage &img) const override;
-        //! Translate the line by a given vector.
-        //! @param t Translation vector.
-        void translate(Point &t) override;
-        //! Rotate the line around a given point.
-        //! @param origin Point to rotate around.
-        //! @param degrees Degrees to rotate.
-        void rotate(const Point &origin, int degrees) override;
-        //! Scale the line around a given point.
-        //! @param origin Point to scale around.
-        //! @param v Scale factor.
-        void scale(const Point &origin, int v) override;
-        //! Create a deep copy of the line.
-        //! @return Pointer to the cloned line.
-        Line* clone() const override;
+        //! Append the commands drawing the line to a display list
+        //! @param list Display list
+        //! @param outer Transformation of the groups containing the line
+        void flatten(DisplayList &list, const Transform &outer) const override;
     private:
         //! First point
         Point start;
@@ -292,38 +345,67 @@ namespace svg
     };
     //! @class Group
     //! @brief Class that represents an SVG group
-    //! The class provides methods for drawing,
-    //! translating, rotating, and scaling the group.
-    //! The class also provides a clone method
-    //! that creates a deep copy of the object.
+    //! The class provides methods for drawing the group,
+    //! whose transformation applies to all its elements.
     class Group : public SVGElement
     {
     public:
-        //! Constructor
-        //! @param elements Vector of SVG elements.
-        Group(const std::vector<SVGElement *> &elements);
+        //! Constructor, making the group the parent of its elements
+        //! @param elements SVG elements, stored in an arena or another
+        //! storage outliving the group.
+        Group(Span<SVGElement *> elements);
         //! Destructor
         ~Group();
-        //! Draw the group on the PNG image.
-        //! @param img PNG image.
-        void draw(PNGImage &img) const override;
-        //! Translate the group by a given vector.
-        //! @param t Translation vector.
-        void translate(Point &t) override;
-        //! Rotate the group around a given point.
-        //! @param origin Point to rotate around.
-        //! @param degrees Degrees to rotate.
-        void rotate(const Point &origin, int degrees) override;
-        //! Scale the group around a given point.
-        //! @param origin Point to scale around.
-        //! @param v Scale factor.
-        void scale(const Point &origin, int v) override;
-        //! Create a deep copy of the group.
-        //! @return Pointer to the cloned group.
-        Group* clone() const override;
+        //! Append the commands drawing the group to a display list
+        //! @param list Display list
+        //! @param outer Transformation of the groups containing the group
+        void flatten(DisplayList &list, const Transform &outer) const override;
+        bool draws(const SVGElement *element) const override;
+    private:
+        //! SVG elements
+        Span<SVGElement *> elements;
+    };
+    //! @class Use
+    //! @brief Class that represents an SVG use element
+    //! The element shares the element it refers to instead of copying
+    //! it. Since elements are not changed by transformations, the
+    //! shared element is drawn as it was when the use element was read:
+    //! with its own transformation and that of the groups around it
+    //! which were already read, followed by the transformation of
+    //! the use element.
+    class Use : public SVGElement
+    {
+    public:
+        //! Constructor
+        //! @param element Element to share, or nullptr for an element
+        //! that is only read after the use element (see resolve).
+        Use(const SVGElement *element);
+        //! Destructor
+        ~Use();
+        //! Set the element to share, for a reference that could not be
+        //! resolved when the use element was read.
+        //! @param element Element to share.
+        //! @param read_before Whether the element and the groups around
+        //! it were read before the use element, as in the constructor
+        //! (when parts of a document are read separately); otherwise,
+        //! for a forward reference, none of these groups apply.
+        void resolve(const SVGElement *element, bool read_before);
+        //! Check if the element to share is known
+        //! @return false for an unresolved forward reference
+        bool resolved() const;
+        //! Append the commands drawing the shared element (if resolved)
+        //! to a display list
+        //! @param list Display list
+        //! @param outer Transformation of the groups containing the use element
+        void flatten(DisplayList &list, const Transform &outer) const override;
+        bool draws(const SVGElement *element) const override;
     private:
-        //! Vector of SVG elements
-        std::vector<SVGElement *> elements;
+        //! Shared element.
+        const SVGElement *element;
+        //! Outermost group around the shared element when the use
+        //! element was read, or the element itself if it had no group
+        //! (or was read later).
+        const SVGElement *top;
     };
 }
-#endif
\ No newline at end of file
+#endif
@@ -0,0 +1,176 @@
+//! @file Transform.cpp
+#include <cmath>
+#include "Transform.hpp"
+
+namespace svg
+{
+    bool whole_number(double v)
+    {
+        return v == std::floor(v) && std::fabs(v) < 2147483648.0;
+    }
+
+    Point Transform::Exact::apply(const Point &p) const
+    {
+        return {xx * p.x + xy * p.y + t.x, yx * p.x + yy * p.y + t.y};
+    }
+
+    Transform::Exact Transform::Exact::then(const Exact &outer) const
+    {
+        return {outer.xx * xx + outer.xy * yx, outer.xx * xy + outer.xy * yy,
+                outer.yx * xx + outer.yy * yx, outer.yx * xy + outer.yy * yy,
+                outer.apply(t)};
+    }
+
+    Transform::Transform()
+        : pre_{1, 0, 0, 1, {0, 0}},
+          xx_(1), xy_(0), yx_(0), yy_(1), tx_(0), ty_(0),
+          post_{1, 0, 0, 1, {0, 0}},
+          rounded_(false)
+    {
+    }
+
+    bool Transform::identity() const
+    {
+        return !rounded_ && pre_.xx == 1 && pre_.xy == 0 && pre_.yx == 0 && pre_.yy == 1 &&
+               pre_.t.x == 0 && pre_.t.y == 0;
+    }
+
+    void Transform::translate(const Point &t)
+    {
+        Transform step;
+        step.pre_.t = t;
+        *this = then(step);
+    }
+
+    void Transform::rotate(const Point &origin, int degrees)
+    {
+        Transform step;
+        if (degrees % 90 == 0)
+        {
+            // Exact: the cosine and sine are 0 or +-1.
+            static const int cos_table[4] = {1, 0, -1, 0};
+            static const int sin_table[4] = {0, 1, 0, -1};
+            int quarter = ((degrees / 90) % 4 + 4) % 4;
+            int c = cos_table[quarter];
+            int s = sin_table[quarter];
+            step.pre_ = {c, -s, s, c, {0, 0}};
+            step.pre_.t = {origin.x - (c * origin.x - s * origin.y),
+                           origin.y - (s * origin.x + c * origin.y)};
+        }
+        else
+        {
+            // Same computation as Point::rotate: offset from the origin,
+            // rotated and rounded, then added back to the origin.
+            double angle = M_PI * degrees / 180.0;
+            double s = ::sin(angle);
+            double c = ::cos(angle);
+            step.pre_.t = {-origin.x, -origin.y};
+            step.xx_ = c;
+            step.xy_ = -s;
+            step.yx_ = s;
+            step.yy_ = c;
+            step.post_.t = origin;
+            step.rounded_ = true;
+        }
+        *this = then(step);
+    }
+
+    void Transform::scale(const Point &origin, int v)
+    {
+        Transform step;
+        step.pre_ = {v, 0, 0, v, {origin.x - v * origin.x, origin.y - v * origin.y}};
+        *this = then(step);
+    }
+
+    void Transform::matrix(double a, double b, double c, double d, double e, double f)
+    {
+        Transform step;
+        if (whole_number(a) && whole_number(b) && whole_number(c) && whole_number(d) && whole_number(e) &&
+            whole_number(f))
+        {
+            step.pre_ = {(int)a, (int)c, (int)b, (int)d, {(int)e, (int)f}};
+        }
+        else
+        {
+            step.xx_ = a;
+            step.xy_ = c;
+            step.yx_ = b;
+            step.yy_ = d;
+            step.tx_ = e;
+            step.ty_ = f;
+            step.rounded_ = true;
+        }
+        *this = then(step);
+    }
+
+    Transform Transform::then(const Transform &outer) const
+    {
+        Transform result;
+        if (!outer.rounded_)
+        {
+            // The exact outer transformation becomes part of the last step.
+            result = *this;
+            if (rounded_)
+            {
+                result.post_ = post_.then(outer.pre_);
+            }
+            else
+            {
+                result.pre_ = pre_.then(outer.pre_);
+            }
+        }
+        else if (!rounded_)
+        {
+            // This exact transformation becomes part of the first step.
+            result = outer;
+            result.pre_ = pre_.then(outer.pre_);
+        }
+        else
+        {
+            // Both round: compose the rounding steps (and the exact steps
+            // between them) into one, rounding only once.
+            Exact mid = post_.then(outer.pre_);
+            double mxx = outer.xx_ * mid.xx + outer.xy_ * mid.yx;
+            double mxy = outer.xx_ * mid.xy + outer.xy_ * mid.yy;
+            double myx = outer.yx_ * mid.xx + outer.yy_ * mid.yx;
+            double myy = outer.yx_ * mid.xy + outer.yy_ * mid.yy;
+            result.pre_ = pre_;
+            result.xx_ = mxx * xx_ + mxy * yx_;
+            result.xy_ = mxx * xy_ + mxy * yy_;
+            result.yx_ = myx * xx_ + myy * yx_;
+            result.yy_ = myx * xy_ + myy * yy_;
+            result.tx_ = mxx * tx_ + mxy * ty_ + outer.xx_ * mid.t.x + outer.xy_ * mid.t.y + outer.tx_;
+            result.ty_ = myx * tx_ + myy * ty_ + outer.yx_ * mid.t.x + outer.yy_ * mid.t.y + outer.ty_;
+            result.post_ = outer.post_;
+            result.rounded_ = true;
+        }
+        return result;
+    }
+
+    Point Transform::apply(const Point &p) const
+    {
+        Point q = pre_.apply(p);
+        if (!rounded_)
+        {
+            return q;
+        }
+        double dx = q.x;
+        double dy = q.y;
+        Point r = {(int)::lround(xx_ * dx + xy_ * dy + tx_),
+                   (int)::lround(yx_ * dx + yy_ * dy + ty_)};
+        return post_.apply(r);
+    }
+
+    Transform::Linear Transform::linear() const
+    {
+        Linear l = {(double)pre_.xx, (double)pre_.xy, (double)pre_.yx, (double)pre_.yy};
+        if (!rounded_)
+        {
+            return l;
+        }
+        l = {xx_ * l.xx + xy_ * l.yx, xx_ * l.xy + xy_ * l.yy,
+             yx_ * l.xx + yy_ * l.yx, yx_ * l.xy + yy_ * l.yy};
+        return {post_.xx * l.xx + post_.xy * l.yx, post_.xx * l.xy + post_.xy * l.yy,
+                post_.yx * l.xx + post_.yy * l.yx, post_.yx * l.xy + post_.yy * l.yy};
+    }
+}
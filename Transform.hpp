@@ -0,0 +1,92 @@
+//! @file Transform.hpp
+#ifndef __svg_Transform_hpp__
+#define __svg_Transform_hpp__
+
+#include "Point.hpp"
+
+namespace svg
+{
+    //! Check if a number is a whole number that fits an int, so that
+    //! it can be cast to int (false for NaN and infinities).
+    //! @param v Number.
+    //! @return true if v is a whole number in the range of int.
+    bool whole_number(double v);
+
+    //! Affine transformation of the plane.
+    //! Transformations are composed instead of being applied to the
+    //! points one after the other, and the result is applied once to
+    //! every point, when the elements are compiled.
+    //! Translations, integer scalings and rotations by multiples of
+    //! 90 degrees are exact on whole pixels, while other rotations and
+    //! matrices round their result to whole pixels. A transformation
+    //! keeps the exact steps before and after a rounding step apart,
+    //! so that with a single rounding step it gives the same pixels as
+    //! applying the steps one after the other. When two rounding steps
+    //! are composed, such as nested rotations that are not multiples of
+    //! 90 degrees, the result is only rounded once, at the end, and can
+    //! differ by a pixel from rounding after each step.
+    class Transform
+    {
+    public:
+        //! Constructor, creating the identity transformation.
+        Transform();
+        //! Check if the transformation leaves all points unchanged.
+        //! @return true for the identity transformation.
+        bool identity() const;
+        //! Translate after the transformation.
+        //! @param t Translation vector.
+        void translate(const Point &t);
+        //! Rotate after the transformation.
+        //! @param origin Point to rotate around.
+        //! @param degrees Degrees to rotate.
+        void rotate(const Point &origin, int degrees);
+        //! Scale after the transformation.
+        //! @param origin Point to scale around.
+        //! @param v Scale factor.
+        void scale(const Point &origin, int v);
+        //! Apply a matrix after the transformation, mapping (x, y)
+        //! to (a x + c y + e, b x + d y + f) as SVG's matrix().
+        void matrix(double a, double b, double c, double d, double e, double f);
+        //! Compose with another transformation.
+        //! @param outer Transformation applied after this one.
+        //! @return The composed transformation.
+        Transform then(const Transform &outer) const;
+        //! Transform a point.
+        //! @param p Point.
+        //! @return Transformed point.
+        Point apply(const Point &p) const;
+        //! Linear part of a transformation (without its translation),
+        //! mapping (x, y) to (xx x + xy y, yx x + yy y).
+        struct Linear
+        {
+            double xx, xy, yx, yy;
+        };
+        //! Get the linear part of the transformation, which transforms
+        //! lengths and directions, such as the axes of an ellipse.
+        //! @return Linear part, from all steps.
+        Linear linear() const;
+
+    private:
+        //! Transformation with integer coefficients, mapping p to
+        //! (xx p.x + xy p.y + t.x, yx p.x + yy p.y + t.y).
+        struct Exact
+        {
+            int xx, xy, yx, yy;
+            Point t;
+
+            Point apply(const Point &p) const;
+            Exact then(const Exact &outer) const;
+        };
+        //! Exact step applied first, the whole transformation if
+        //! there is no rounding step.
+        Exact pre_;
+        //! Rounding step, with the same layout as pre_.
+        double xx_, xy_, yx_, yy_, tx_, ty_;
+        //! Exact step applied last.
+        Exact post_;
+        //! Whether there is a rounding step.
+        bool rounded_;
+    };
+}
+
+#endif
@@ -0,0 +1,533 @@
+//! @file XMLReader.cpp
+#include <algorithm>
+#include <cstdlib>
+#include <cstring>
+#include <stdexcept>
+#include "XMLReader.hpp"
+
+namespace svg
+{
+    namespace
+    {
+        //! Check for XML white space.
+        bool is_space(char c)
+        {
+            return c == ' ' || c == '\t' || c == '\n' || c == '\r';
+        }
+
+        //! Append a character as UTF-8.
+        void put_utf8(std::string &out, unsigned long c)
+        {
+            if (c < 0x80)
+            {
+                out += (char)c;
+            }
+            else if (c < 0x800)
+            {
+                out += (char)(0xC0 | (c >> 6));
+                out += (char)(0x80 | (c & 0x3F));
+            }
+            else if (c < 0x10000)
+            {
+                out += (char)(0xE0 | (c >> 12));
+                out += (char)(0x80 | ((c >> 6) & 0x3F));
+                out += (char)(0x80 | (c & 0x3F));
+            }
+            else
+            {
+                out += (char)(0xF0 | (c >> 18));
+                out += (char)(0x80 | ((c >> 12) & 0x3F));
+                out += (char)(0x80 | ((c >> 6) & 0x3F));
+                out += (char)(0x80 | (c & 0x3F));
+            }
+        }
+
+        //! Copy a value, replacing its entities and character references.
+        void decode(const char *begin, const char *end, std::string &out)
+        {
+            static const struct
+            {
+                const char *name;
+                char c;
+            } entities[] = {{"lt;", '<'}, {"gt;", '>'}, {"amp;", '&'}, {"quot;", '"'}, {"apos;", '\''}};
+            out.reserve(end - begin);
+            for (const char *p = begin; p < end;)
+            {
+                if (*p != '&')
+                {
+                    out += *p++;
+                    continue;
+                }
+                const char *semicolon = (const char *)std::memchr(p, ';', std::min<size_t>(end - p, 12));
+                bool replaced = false;
+                if (semicolon != nullptr && p[1] == '#')
+                {
+                    char *digits_end;
+                    unsigned long c = p[2] == 'x' ? std::strtoul(p + 3, &digits_end, 16)
+                                                  : std::strtoul(p + 2, &digits_end, 10);
+                    if (digits_end == semicolon && c > 0 && c < 0x110000)
+                    {
+                        put_utf8(out, c);
+                        p = semicolon + 1;
+                        replaced = true;
+                    }
+                }
+                else if (semicolon != nullptr)
+                {
+                    for (const auto &entity : entities)
+                    {
+                        size_t n = std::strlen(entity.name);
+                        if ((size_t)(semicolon + 1 - (p + 1)) == n && std::memcmp(p + 1, entity.name, n) == 0)
+                        {
+                            out += entity.c;
+                            p = semicolon + 1;
+                            replaced = true;
+                            break;
+                        }
+                    }
+                }
+                if (!replaced)
+                {
+                    // Unknown entities are kept as they are.
+                    out += *p++;
+                }
+            }
+        }
+    }
+
+    XMLReader::XMLReader(std::FILE *file, size_t chunk_size)
+        : file_(file), data_(nullptr), pos_(0), len_(0), chunk_size_(std::max<size_t>(chunk_size, 16)),
+          name_{"", 0}, empty_(false)
+    {
+    }
+
+    XMLReader::XMLReader(const char *data, size_t size)
+        : file_(nullptr), data_(data), pos_(0), len_(size), chunk_size_(0),
+          name_{"", 0}, empty_(false)
+    {
+    }
+
+    bool XMLReader::more()
+    {
+        if (file_ == nullptr)
+        {
+            // The whole block of memory is already there.
+            return false;
+        }
+        if (pos_ > 0)
+        {
+            std::memmove(buffer_.data(), buffer_.data() + pos_, len_ - pos_);
+            len_ -= pos_;
+            pos_ = 0;
+        }
+        if (buffer_.size() - len_ < chunk_size_)
+        {
+            buffer_.resize(len_ + chunk_size_);
+        }
+        size_t n = std::fread(buffer_.data() + len_, 1, buffer_.size() - len_, file_);
+        len_ += n;
+        data_ = buffer_.data();
+        return n > 0;
+    }
+
+    size_t XMLReader::find(const char *s, size_t from)
+    {
+        const size_t n = std::strlen(s);
+        while (true)
+        {
+            const char *begin = data_ + pos_ + from;
+            const char *end = data_ + len_;
+            const char *found = std::search(begin, end, s, s + n);
+            if (found != end)
+            {
+                return found - (data_ + pos_);
+            }
+            // The string may start in the last n - 1 bytes.
+            from = std::max(from, (len_ - pos_ >= n ? len_ - pos_ - n + 1 : 0));
+            if (!more())
+            {
+                return std::string::npos;
+            }
+        }
+    }
+
+    size_t XMLReader::find_tag_end()
+    {
+        char quote = 0;
+        int brackets = 0;
+        for (size_t i = 1;; i++)
+        {
+            if (pos_ + i == len_ && !more())
+            {
+                return std::string::npos;
+            }
+            char c = data_[pos_ + i];
+            if (quote != 0)
+            {
+                if (c == quote)
+                {
+                    quote = 0;
+                }
+            }
+            else if (c == '"' || c == '\'')
+            {
+                quote = c;
+            }
+            else if (c == '[')
+            {
+                // Internal subset of a document type declaration.
+                brackets++;
+            }
+            else if (c == ']' && brackets > 0)
+            {
+                brackets--;
+            }
+            else if (c == '>' && brackets == 0)
+            {
+                return i;
+            }
+        }
+    }
+
+    XMLReader::Event XMLReader::next()
+    {
+        attributes_.clear();
+        decoded_.clear();
+        if (empty_)
+        {
+            empty_ = false;
+            open_.pop_back();
+            return Event::End;
+        }
+        while (true)
+        {
+            // Skip text up to the next markup.
+            const char *lt = pos_ < len_ ? (const char *)std::memchr(data_ + pos_, '<', len_ - pos_)
+                                         : nullptr;
+            if (lt == nullptr)
+            {
+                pos_ = len_;
+                if (!more())
+                {
+                    if (!open_.empty())
+                    {
+                        error("unexpected end of file");
+                    }
+                    return Event::Done;
+                }
+                continue;
+            }
+            pos_ = lt - data_;
+            // Enough bytes to tell the kind of markup.
+            while (len_ - pos_ < 9 && more())
+            {
+            }
+            auto starts_with = [this](const char *s)
+            {
+                size_t n = std::strlen(s);
+                return len_ - pos_ >= n && std::memcmp(data_ + pos_, s, n) == 0;
+            };
+            size_t end;
+            if (starts_with("<!--"))
+            {
+                end = find("-->", 4);
+                if (end == std::string::npos)
+                {
+                    error("unterminated comment");
+                }
+                pos_ += end + 3;
+            }
+            else if (starts_with("<![CDATA["))
+            {
+                end = find("]]>", 9);
+                if (end == std::string::npos)
+                {
+                    error("unterminated CDATA section");
+                }
+                pos_ += end + 3;
+            }
+            else if (starts_with("<?"))
+            {
+                end = find("?>", 2);
+                if (end == std::string::npos)
+                {
+                    error("unterminated processing instruction");
+                }
+                pos_ += end + 2;
+            }
+            else if (starts_with("<!"))
+            {
+                end = find_tag_end();
+                if (end == std::string::npos)
+                {
+                    error("unterminated declaration");
+                }
+                pos_ += end + 1;
+            }
+            else if (starts_with("</"))
+            {
+                end = find_tag_end();
+                if (end == std::string::npos)
+                {
+                    error("unterminated end tag");
+                }
+                const char *name = data_ + pos_ + 2;
+                const char *name_end = data_ + pos_ + end;
+                while (name_end > name && is_space(name_end[-1]))
+                {
+                    name_end--;
+                }
+                name_ = {name, (size_t)(name_end - name)};
+                if (open_.empty() || name_ != open_.back().c_str())
+                {
+                    error("mismatched end tag");
+                }
+                open_.pop_back();
+                pos_ += end + 1;
+                return Event::End;
+            }
+            else
+            {
+                end = find_tag_end();
+                if (end == std::string::npos)
+                {
+                    error("unterminated start tag");
+                }
+                parse_start_tag(end);
+                pos_ += end + 1;
+                open_.push_back(name_.str());
+                return Event::Start;
+            }
+        }
+    }
+
+    void XMLReader::parse_start_tag(size_t end)
+    {
+        const char *p = data_ + pos_ + 1;
+        const char *e = data_ + pos_ + end;
+        if (e > p && e[-1] == '/')
+        {
+            empty_ = true;
+            e--;
+        }
+        const char *name = p;
+        while (p < e && !is_space(*p))
+        {
+            p++;
+        }
+        if (p == name)
+        {
+            error("missing element name");
+        }
+        name_ = {name, (size_t)(p - name)};
+        while (true)
+        {
+            while (p < e && is_space(*p))
+            {
+                p++;
+            }
+            if (p >= e)
+            {
+                break;
+            }
+            const char *attribute = p;
+            while (p < e && *p != '=' && !is_space(*p))
+            {
+                p++;
+            }
+            const char *attribute_end = p;
+            while (p < e && is_space(*p))
+            {
+                p++;
+            }
+            if (p >= e || *p != '=')
+            {
+                error("missing attribute value");
+            }
+            p++;
+            while (p < e && is_space(*p))
+            {
+                p++;
+            }
+            if (p >= e || (*p != '"' && *p != '\''))
+            {
+                error("unquoted attribute value");
+            }
+            char quote = *p++;
+            const char *value = p;
+            const char *ampersand = nullptr;
+            while (p < e && *p != quote)
+            {
+                if (*p == '&' && ampersand == nullptr)
+                {
+                    ampersand = p;
+                }
+                p++;
+            }
+            if (p >= e)
+            {
+                error("unterminated attribute value");
+            }
+            attributes_.push_back({attribute, (size_t)(attribute_end - attribute)});
+            if (ampersand == nullptr)
+            {
+                attributes_.push_back({value, (size_t)(p - value)});
+            }
+            else
+            {
+                // Only values with entities are copied.
+                decoded_.emplace_back();
+                decode(value, p, decoded_.back());
+                attributes_.push_back({decoded_.back().c_str(), decoded_.back().size()});
+            }
+            p++;
+        }
+    }
+
+    Slice XMLReader::name() const
+    {
+        return name_;
+    }
+
+    Slice XMLReader::attribute(const char *name) const
+    {
+        for (size_t i = 0; i < attributes_.size(); i += 2)
+        {
+            if (attributes_[i] == name)
+            {
+                return attributes_[i + 1];
+            }
+        }
+        return {nullptr, 0};
+    }
+
+    size_t XMLReader::attribute_count() const
+    {
+        return attributes_.size() / 2;
+    }
+
+    Slice XMLReader::attribute_name(size_t i) const
+    {
+        return attributes_[2 * i];
+    }
+
+    Slice XMLReader::attribute_value(size_t i) const
+    {
+        return attributes_[2 * i + 1];
+    }
+
+    bool XMLReader::persistent(Slice s) const
+    {
+        uintptr_t begin = (uintptr_t)data_;
+        return file_ == nullptr && (uintptr_t)s.data >= begin && (uintptr_t)s.end() <= begin + len_;
+    }
+
+    std::vector<Slice> XMLReader::split_children(size_t parts, size_t min_size) const
+    {
+        std::vector<Slice> ranges;
+        if (file_ != nullptr || open_.empty() || empty_)
+        {
+            return ranges;
+        }
+        const char *end = data_ + len_;
+        size_t step = std::max((len_ - pos_) / std::max<size_t>(parts, 1), min_size);
+        const char *range = data_ + pos_;
+        // Only the structure is scanned: markup that does not open or close
+        // an element is skipped, and start tags only up to their end.
+        auto starts_with = [end](const char *p, const char *s)
+        {
+            size_t n = std::strlen(s);
+            return (size_t)(end - p) >= n && std::memcmp(p, s, n) == 0;
+        };
+        auto skip_past = [end](const char *p, const char *s)
+        {
+            const char *found = std::search(p, end, s, s + std::strlen(s));
+            return found == end ? nullptr : found + std::strlen(s);
+        };
+        size_t depth = 0;
+        for (const char *p = range;;)
+        {
+            p = (const char *)std::memchr(p, '<', end - p);
+            if (p == nullptr || end - p < 2)
+            {
+                return std::vector<Slice>();
+            }
+            if (p[1] == '!' || p[1] == '?')
+            {
+                const char *next = nullptr;
+                if (starts_with(p, "<!--"))
+                {
+                    next = skip_past(p + 4, "-->");
+                }
+                else if (starts_with(p, "<![CDATA["))
+                {
+                    next = skip_past(p + 9, "]]>");
+                }
+                else if (p[1] == '?')
+                {
+                    next = skip_past(p + 2, "?>");
+                }
+                else
+                {
+                    // Declaration, possibly with an internal subset.
+                    int brackets = 0;
+                    for (const char *q = p + 2; q < end && next == nullptr; q++)
+                    {
+                        brackets += *q == '[' ? 1 : *q == ']' && brackets > 0 ? -1 : 0;
+                        next = *q == '>' && brackets == 0 ? q + 1 : nullptr;
+                    }
+                }
+                if (next == nullptr)
+                {
+                    return std::vector<Slice>();
+                }
+                p = next;
+                continue;
+            }
+            if (p[1] != '/' && depth == 0 && (size_t)(p - range) >= step && ranges.size() + 1 < parts)
+            {
+                ranges.push_back(Slice{range, (size_t)(p - range)});
+                range = p;
+            }
+            const char *q = p + 1;
+            for (char quote = 0; q < end && (quote != 0 || *q != '>'); q++)
+            {
+                quote = quote == 0 && (*q == '"' || *q == '\'') ? *q : quote == *q ? 0 : quote;
+            }
+            if (q == end)
+            {
+                return std::vector<Slice>();
+            }
+            if (p[1] == '/' && depth == 0)
+            {
+                // End tag of the element, which next() would report as
+                // mismatched if it ends another element.
+                const char *name_end = q;
+                while (name_end > p + 2 && is_space(name_end[-1]))
+                {
+                    name_end--;
+                }
+                if (Slice{p + 2, (size_t)(name_end - (p + 2))} != open_.back().c_str())
+                {
+                    return std::vector<Slice>();
+                }
+                ranges.push_back(Slice{range, (size_t)(p - range)});
+                return ranges;
+            }
+            if (p[1] == '/')
+            {
+                depth--;
+            }
+            else if (q[-1] != '/')
+            {
+                depth++;
+            }
+            p = q + 1;
+        }
+    }
+
+    void XMLReader::error(const char *what) const
+    {
+        throw std::runtime_error(std::string("Malformed XML: ") + what);
+    }
+}
@@ -0,0 +1,178 @@
+//! @file XMLReader.hpp
+#ifndef __svg_XMLReader_hpp__
+#define __svg_XMLReader_hpp__
+
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <deque>
+#include <string>
+#include <vector>
+
+namespace svg
+{
+    //! Characters of a name or value read by XMLReader, referring to
+    //! the input of the reader instead of being copied, and therefore
+    //! not terminated. A missing value has a null data pointer.
+    struct Slice
+    {
+        //! First character.
+        const char *data;
+        //! Number of characters.
+        size_t size;
+
+        const char *begin() const { return data; }
+        const char *end() const { return data + size; }
+        bool empty() const { return size == 0; }
+        //! Check if the slice refers to a value.
+        explicit operator bool() const { return data != nullptr; }
+        //! Compare with a null-terminated string.
+        bool operator==(const char *s) const
+        {
+            return std::strncmp(data, s, size) == 0 && s[size] == '\0';
+        }
+        bool operator!=(const char *s) const { return !(*this == s); }
+        //! Copy the characters.
+        std::string str() const { return std::string(data, size); }
+    };
+
+    //! Hash a name (FNV-1a), in constant expressions such as case labels.
+    //! @param s Null-terminated name.
+    //! @param h Hash of the characters before s.
+    //! @return Hash.
+    constexpr uint32_t hash_name(const char *s, uint32_t h = 2166136261u)
+    {
+        return *s == '\0' ? h : hash_name(s + 1, (h ^ (unsigned char)*s) * 16777619u);
+    }
+
+    //! Hash a name read by XMLReader, as hash_name(const char *).
+    //! @param s Name.
+    //! @return Hash.
+    inline uint32_t hash_name(Slice s)
+    {
+        uint32_t h = 2166136261u;
+        for (char c : s)
+        {
+            h = (h ^ (unsigned char)c) * 16777619u;
+        }
+        return h;
+    }
+
+    //! Streaming reader of XML files.
+    //! Tags are returned one at a time, without building a document:
+    //! only the current tag (and the names of the open elements) are
+    //! kept. The input is either a file, read in chunks, or a block of
+    //! memory such as a mapped file, which is read in place and never
+    //! copied. Text, comments, declarations and processing instructions
+    //! are skipped.
+    //! Malformed XML (unterminated markup, mismatched end tags) throws
+    //! std::runtime_error.
+    class XMLReader
+    {
+    public:
+        //! Kind of tag read by next().
+        enum class Event
+        {
+            //! Start tag; an empty element tag (<a/>) gives a Start
+            //! followed by an End.
+            Start,
+            //! End tag.
+            End,
+            //! End of the input.
+            Done
+        };
+        //! Constructor, reading a file.
+        //! @param file File to read, which is not closed by the reader.
+        //! @param chunk_size Number of bytes read at a time.
+        explicit XMLReader(std::FILE *file, size_t chunk_size = 65536);
+        //! Constructor, reading a block of memory.
+        //! @param data First byte, which must stay valid while the
+        //! reader and the slices it returns are used.
+        //! @param size Number of bytes.
+        XMLReader(const char *data, size_t size);
+        XMLReader(const XMLReader &) = delete;
+        XMLReader &operator=(const XMLReader &) = delete;
+        //! Read the next tag.
+        //! @return Kind of tag.
+        Event next();
+        //! Get the name of the element of the last tag.
+        //! @return Name, valid until the next call to next() when
+        //! reading a file.
+        Slice name() const;
+        //! Get an attribute of the last start tag, with its entities
+        //! and character references replaced.
+        //! @param name Attribute name.
+        //! @return Value, valid until the next call to next() (until
+        //! the reader is destroyed when reading a block of memory and
+        //! the value has no entities), or a slice with a null data
+        //! pointer if the tag has no such attribute.
+        Slice attribute(const char *name) const;
+        //! Get the number of attributes of the last start tag.
+        //! @return Number of attributes.
+        size_t attribute_count() const;
+        //! Get the name of an attribute of the last start tag.
+        //! @param i Index of the attribute, in the order of the tag.
+        //! @return Name, valid as the element name.
+        Slice attribute_name(size_t i) const;
+        //! Get the value of an attribute of the last start tag.
+        //! @param i Index of the attribute, in the order of the tag.
+        //! @return Value, valid as the values returned by attribute().
+        Slice attribute_value(size_t i) const;
+        //! Check if a name or value stays valid after the next tag, which
+        //! is the case when it refers to a block of memory being read
+        //! (and not to a copy with its entities replaced).
+        //! @param s Name or value returned by the reader.
+        //! @return true if s is valid as long as the block of memory.
+        bool persistent(Slice s) const;
+        //! Split the children of the last element into ranges, to read
+        //! them separately (each with a reader of its own), when reading
+        //! a block of memory. Ranges start with a start tag and hold whole
+        //! elements; the reader itself is not moved.
+        //! @param parts Largest number of ranges.
+        //! @param min_size Smallest size of a range, in bytes.
+        //! @return The ranges, in order, or no range if the children
+        //! cannot be split (when reading a file, or if the XML is
+        //! malformed, which next() reports).
+        std::vector<Slice> split_children(size_t parts, size_t min_size) const;
+
+    private:
+        //! Move the unread bytes to the front of the buffer and read more.
+        //! @return false at the end of the input.
+        bool more();
+        //! Find a string in the unread bytes, reading more as needed.
+        //! @return Offset from pos_, or std::string::npos if not found.
+        size_t find(const char *s, size_t from);
+        //! Find the end of a start or end tag, skipping quoted values.
+        //! @return Offset of '>' from pos_, or std::string::npos.
+        size_t find_tag_end();
+        //! Split a start tag into its name and attributes.
+        //! @param end Offset of the closing '>' from pos_.
+        void parse_start_tag(size_t end);
+        //! Throw a std::runtime_error.
+        [[noreturn]] void error(const char *what) const;
+        //! Read file, nullptr when reading a block of memory.
+        std::FILE *file_;
+        //! Bytes read from the file.
+        std::vector<char> buffer_;
+        //! Input: the block of memory, or the data of buffer_.
+        const char *data_;
+        //! Offset of the first unread byte in data_.
+        size_t pos_;
+        //! Number of valid bytes in data_.
+        size_t len_;
+        //! Number of bytes read at a time.
+        size_t chunk_size_;
+        //! Name of the last element.
+        Slice name_;
+        //! Names and values of the attributes of the last start tag.
+        std::vector<Slice> attributes_;
+        //! Values of the last start tag with their entities replaced.
+        std::deque<std::string> decoded_;
+        //! Names of the open elements.
+        std::vector<std::string> open_;
+        //! Whether the last start tag was an empty element tag.
+        bool empty_;
+    };
+}
+
+#endif
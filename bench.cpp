@@ -0,0 +1,277 @@
+// Project file headers
+#include "FillKernels.hpp"
+#include "SVGElements.hpp"
+#define STB_IMAGE_WRITE_IMPLEMENTATION
+#include "external/stb/stb_image_write.h"
+
+// C++ library headers
+#include <algorithm>
+#include <chrono>
+#include <cstdlib>
+#include <functional>
+#include <iomanip>
+#include <iostream>
+#include <memory>
+#include <string>
+#include <vector>
+using namespace std;
+
+// POSIX headers
+#include <dirent.h>
+
+namespace svg
+{
+    //! Micro-benchmarks for the raster kernels.
+    class Bench
+    {
+    private:
+        //! Pixels in the benchmark canvas (4096 x 4096).
+        static const size_t CANVAS_PIXELS = 4096 * 4096;
+        //! Bytes written by each measurement.
+        static const size_t BYTES_PER_RUN = (size_t)1 << 30;
+
+        vector<Color> canvas;
+        vector<uint32_t> canvas32;
+
+        //! Measure fill bandwidth for runs of a given length.
+        //! Runs are spread over the canvas, as spans of a shape are.
+        //! @param fill Function filling n pixels from a pixel index.
+        //! @param pixels Pixels in the canvas.
+        //! @param bpp Bytes per pixel.
+        //! @return Bandwidth in GB/s.
+        template <typename Fill>
+        double measure(Fill fill, size_t pixels, size_t bpp, size_t run)
+        {
+            size_t runs = BYTES_PER_RUN / (run * bpp);
+            size_t stride = run + 7;
+            size_t offset = 0;
+            auto start = chrono::steady_clock::now();
+            for (size_t i = 0; i < runs; i++)
+            {
+                if (offset + run > pixels)
+                {
+                    offset = i % 17;
+                }
+                fill(offset, run);
+                offset += stride;
+            }
+            chrono::duration<double> secs = chrono::steady_clock::now() - start;
+            return (double)runs * run * bpp / secs.count() / 1e9;
+        }
+
+        //! Measure the time to draw lines with a given direction.
+        //! @param img Image to draw on.
+        //! @param dx X distance between the line end points.
+        //! @param dy Y distance between the line end points.
+        //! @return Drawn pixels per second, in millions.
+        double measure_lines(PNGImage &img, int dx, int dy)
+        {
+            const int lines = 20000;
+            const Color c = {0x12, 0x34, 0x56};
+            int length = max(abs(dx), abs(dy));
+            auto start = chrono::steady_clock::now();
+            for (int i = 0; i < lines; i++)
+            {
+                Point a = {(i * 7) % (img.width() - abs(dx)), (i * 13) % (img.height() - abs(dy))};
+                img.draw_line(a, {a.x + dx, a.y + dy}, c);
+            }
+            chrono::duration<double> secs = chrono::steady_clock::now() - start;
+            return (double)lines * (length + 1) / secs.count() / 1e6;
+        }
+
+        //! Add up the bytes written by stbi_write_png_to_func.
+        static void count_bytes(void *context, void *, int size)
+        {
+            *(size_t *)context += size;
+        }
+
+    public:
+        Bench() : canvas(CANVAS_PIXELS), canvas32(CANVAS_PIXELS) {}
+
+        //! Compare PNG encoders on the images of a directory.
+        //! @param dir_path Directory of the images.
+        void run_png(const string &dir_path)
+        {
+            vector<unique_ptr<PNGImage>> images;
+            size_t raw_bytes = 0;
+            if (::DIR *directory = ::opendir(dir_path.c_str()))
+            {
+                while (::dirent *entry = ::readdir(directory))
+                {
+                    string name = entry->d_name;
+                    if (name.size() > 4 && name.compare(name.size() - 4, 4, ".png") == 0)
+                    {
+                        images.emplace_back(new PNGImage(dir_path + "/" + name));
+                        raw_bytes += (size_t)images.back()->width() * images.back()->height() * 3;
+                    }
+                }
+                ::closedir(directory);
+            }
+            cout << "== PNG encoding of " << images.size() << " images in " << dir_path
+                 << " (" << raw_bytes << " bytes of pixels) ==" << endl;
+            // Encode all the images, returning the total size.
+            auto measure_png = [&](const string &name, function<size_t(const PNGImage &)> encode)
+            {
+                size_t bytes = 0;
+                auto start = chrono::steady_clock::now();
+                for (const auto &img : images)
+                {
+                    bytes += encode(*img);
+                }
+                chrono::duration<double> secs = chrono::steady_clock::now() - start;
+                cout << setw(24) << name << setw(10) << bytes << " bytes" << setw(10) << fixed
+                     << setprecision(1) << raw_bytes / secs.count() / 1e6 << " MB/s" << endl;
+            };
+            measure_png("stb_image_write", [](const PNGImage &img)
+                        {
+                            size_t bytes = 0;
+                            ::stbi_write_png_to_func(count_bytes, &bytes, img.width(), img.height(), 3,
+                                                     img.row(0), (int)img.stride());
+                            return bytes; });
+            const struct
+            {
+                const char *name;
+                int level;
+                PNGFilter filter;
+                bool palette;
+                unsigned threads;
+            } kinds[] = {{"level 1, up", 1, PNGFilter::Up, true, 1},
+                         {"level 6, up", 6, PNGFilter::Up, true, 1},
+                         {"level 9, up", 9, PNGFilter::Up, true, 1},
+                         {"level 6, paeth", 6, PNGFilter::Paeth, true, 1},
+                         {"level 6, adaptive", 6, PNGFilter::Adaptive, true, 1},
+                         {"level 6, up, no palette", 6, PNGFilter::Up, false, 1},
+                         {"level 6, up, all cores", 6, PNGFilter::Up, true, 0}};
+            for (const auto &k : kinds)
+            {
+                PNGOptions options;
+                options.level = k.level;
+                options.filter = k.filter;
+                options.palette = k.palette;
+                options.threads = k.threads;
+                measure_png(k.name, [&](const PNGImage &img)
+                            {
+                                vector<unsigned char> png;
+                                encode_png(img.row(0), img.width(), img.height(), img.stride(), 3, 3,
+                                           options, png);
+                                return png.size(); });
+            }
+        }
+
+        void run_ellipses()
+        {
+            PNGImage img(2048, 2048);
+            cout << "== Ellipse drawing (ms) ==" << endl;
+            const struct
+            {
+                const char *name;
+                int count, radius;
+            } kinds[] = {{"scatter", 100000, 4}, {"medium", 10000, 40}, {"large", 100, 600}};
+            for (const auto &k : kinds)
+            {
+                srand(1);
+                vector<Circle> circles;
+                for (int i = 0; i < k.count; i++)
+                {
+                    circles.push_back(Circle({0x12, 0x34, 0x56}, {rand() % 2048, rand() % 2048}, k.radius));
+                }
+                auto start = chrono::steady_clock::now();
+                for (const Circle &circle : circles)
+                {
+                    circle.draw(img);
+                }
+                chrono::duration<double> secs = chrono::steady_clock::now() - start;
+                cout << setw(12) << k.name << setw(10) << fixed << setprecision(1)
+                     << secs.count() * 1e3 << " ms for " << k.count << " circles" << endl;
+            }
+        }
+
+        void run_lines()
+        {
+            PNGImage img(2048, 2048);
+            cout << "== Line drawing (Mpixels/s) ==" << endl;
+            const struct
+            {
+                const char *name;
+                int dx, dy;
+            } kinds[] = {{"horizontal", 1000, 0}, {"vertical", 0, 1000},
+                         {"diagonal", 1000, 1000}, {"shallow", 1000, 170},
+                         {"steep", 170, 1000}, {"short", 5, 3}};
+            for (const auto &k : kinds)
+            {
+                cout << setw(12) << k.name << setw(10) << fixed << setprecision(1)
+                     << measure_lines(img, k.dx, k.dy) << endl;
+            }
+            // A trace with many short segments, as in plots.
+            vector<Point> trace;
+            srand(1);
+            Point p = {1024, 1024};
+            for (int i = 0; i < 200000; i++)
+            {
+                p.x = min(max(p.x + rand() % 21 - 10, 0), 2047);
+                p.y = min(max(p.y + rand() % 21 - 10, 0), 2047);
+                trace.push_back(p);
+            }
+            Polyline polyline({0, 0, 0}, {trace.data(), trace.size()});
+            double best = 0;
+            for (int i = 0; i < 5; i++)
+            {
+                auto start = chrono::steady_clock::now();
+                polyline.draw(img);
+                chrono::duration<double> secs = chrono::steady_clock::now() - start;
+                best = i == 0 ? secs.count() : min(best, secs.count());
+            }
+            cout << setw(12) << "polyline" << setw(10) << fixed << setprecision(1)
+                 << best * 1e3 << " ms for " << trace.size() << " points" << endl;
+        }
+
+        void run_fill()
+        {
+            const size_t runs[] = {8, 64, 512, 4096, CANVAS_PIXELS};
+            vector<FillKernelInfo> kernels = fill_kernels();
+            for (size_t bpp = 3; bpp <= 4; bpp++)
+            {
+                cout << "== " << (bpp == 3 ? "RGB" : "32-bit") << " fill bandwidth (GB/s) ==" << endl
+                     << setw(10) << "pixels";
+                for (const FillKernelInfo &k : kernels)
+                {
+                    cout << setw(10) << k.name;
+                }
+                cout << endl;
+                for (size_t run : runs)
+                {
+                    cout << setw(10) << (run == CANVAS_PIXELS ? string("clear") : to_string(run));
+                    for (const FillKernelInfo &k : kernels)
+                    {
+                        double gbs;
+                        if (bpp == 3)
+                        {
+                            Color c = {0x12, 0x34, 0x56};
+                            gbs = measure([&](size_t i, size_t n)
+                                          { k.fill(&canvas[i], n, c); },
+                                          canvas.size(), bpp, run);
+                        }
+                        else
+                        {
+                            gbs = measure([&](size_t i, size_t n)
+                                          { k.fill32(&canvas32[i], n, 0xFF563412u); },
+                                          canvas32.size(), bpp, run);
+                        }
+                        cout << setw(10) << fixed << setprecision(2) << gbs;
+                    }
+                    cout << endl;
+                }
+            }
+        }
+    };
+}
+
+int main()
+{
+    svg::Bench bench;
+    bench.run_fill();
+    bench.run_lines();
+    bench.run_ellipses();
+    bench.run_png("expected");
+    return 0;
+}
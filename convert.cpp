@@ -1,23 +1,113 @@
+#include <cstdio>
+#include <memory>
+#include <stdexcept>
 #include <string>
+#include <unordered_set>
 #include <vector>
 #include "SVGElements.hpp"
 
 namespace svg
 {
-    void convert(const std::string &svg_file, const std::string &png_file)
+    ConvertOptions::ConvertOptions()
+        : threads(0), tile_size(128), antialias(false),
+          format(PixelFormat::RGB8), occlusion_culling(true),
+          compression_level(PNGOptions().level), filter(PNGOptions().filter),
+          band_height(0)
+    {
+    }
+
+    namespace
+    {
+        //! Draws a display list and encodes the image as a PNG file,
+        //! in bands written as they are drawn if the image is large
+        //! (see band_rows).
+        //! @param list Display list
+        //! @param dimensions Image width and height
+        //! @param options Conversion options
+        //! @param sink Function receiving the bytes of the file
+        //! @param stats If not nullptr, set to the work saved by culling
+        void write_png(const DisplayList &list, const Point &dimensions, const ConvertOptions &options,
+                       const PNGWriter::Sink &sink, RenderStats *stats)
+        {
+            const int width = dimensions.x, height = dimensions.y;
+            const bool alpha = options.format == PixelFormat::RGBA8;
+            PNGOptions png;
+            png.level = options.compression_level;
+            png.filter = options.filter;
+            png.threads = options.threads;
+            if (band_rows(width, height, options) == height)
+            {
+                // PNG has no padding byte, so RGBX pixels are written as RGB.
+                render_bands(list, width, height, options, [&](PNGImage &img)
+                             { encode_png(img.row(0), width, height, img.stride(), img.bytes_per_pixel(),
+                                          alpha ? 4 : 3, png, sink); }, stats);
+                return;
+            }
+
+            // The bands are written as they are drawn, so the colors of the
+            // image are not known in advance: without anti-aliasing, pixels
+            // have the background color or the color of a command.
+            std::vector<uint32_t> colors;
+            if (!options.antialias)
+            {
+                std::unordered_set<uint32_t> keys = {alpha ? 0x00FFFFFFu : 0xFFFFFFFFu};
+                for (const DrawCommand &command : list.commands())
+                {
+                    const Color &c = command.color;
+                    keys.insert(c.red | (uint32_t)c.green << 8 | (uint32_t)c.blue << 16 | 0xFF000000u);
+                    if (keys.size() > 256)
+                    {
+                        break;
+                    }
+                }
+                colors.assign(keys.begin(), keys.end());
+            }
+            PNGWriter writer(width, height, options.format == PixelFormat::RGB8 ? 3 : 4, alpha ? 4 : 3,
+                             colors, png, sink);
+            render_bands(list, width, height, options, [&](PNGImage &band)
+                         { writer.write(band.row(band.clip().min.y), band.stride(),
+                                        band.clip().max.y - band.clip().min.y); }, stats);
+            writer.finish();
+        }
+    }
+
+    void convert(const std::string &svg_file, const std::string &png_file, const ConvertOptions &options,
+                 RenderStats *stats)
     {
         Point dimensions;
         std::vector<SVGElement *> svg_elements;
-        readSVG(svg_file, dimensions, svg_elements);
-        PNGImage img(dimensions.x, dimensions.y);
-        for (SVGElement* e : svg_elements)
+        DisplayList list;
+        {
+            // The elements are only needed until they are compiled.
+            Arena arena;
+            readSVG(svg_file, dimensions, svg_elements, arena, options.threads);
+            compile(svg_elements, list);
+        }
+        std::unique_ptr<FILE, int (*)(FILE *)> file(::fopen(png_file.c_str(), "wb"), ::fclose);
+        if (!file)
         {
-            e->draw(img);
+            throw std::runtime_error(png_file + ": could not save image!");
         }
-        img.save(png_file);
-        for (SVGElement* e  : svg_elements)
+        write_png(list, dimensions, options, [&](const unsigned char *data, size_t size)
+                  {
+                      if (::fwrite(data, 1, size, file.get()) != size)
+                      {
+                          throw std::runtime_error(png_file + ": could not save image!");
+                      } }, stats);
+    }
+
+    void convert(const char *svg_data, size_t svg_size, std::vector<unsigned char> &png,
+                 const ConvertOptions &options, RenderStats *stats)
+    {
+        Point dimensions;
+        std::vector<SVGElement *> svg_elements;
+        DisplayList list;
         {
-            delete e;
+            Arena arena;
+            readSVG(svg_data, svg_size, dimensions, svg_elements, arena, options.threads);
+            compile(svg_elements, list);
         }
+        write_png(list, dimensions, options, [&png](const unsigned char *data, size_t size)
+                  { png.insert(png.end(), data, data + size); }, stats);
     }
-}
\ No newline at end of file
+}
@@ -1,467 +1,749 @@
 #include <iostream>
+#include "IdTable.hpp"
+#include "Numbers.hpp"
 #include "SVGElements.hpp"
-#include "external/tinyxml2/tinyxml2.h"
+#include "XMLReader.hpp"
 #include <algorithm>
-#include <map>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <exception>
+#include <memory>
+#include <stdexcept>
+#include <thread>
+#include <sys/mman.h>
+#include <sys/stat.h>
 
 using namespace std;
-using namespace tinyxml2;
 
 namespace svg
 {
-    //! Helper function to apply transformations to SVG elements
-    //! @param element The SVG element to apply the transformation to.
-    //! @param transform_attr The transform attribute string.
-    //! @param transform_origin_attr The transform-origin attribute string.
-    void applyTransform(SVGElement* element, const char* transform_attr, const char* transform_origin_attr) 
+    //! Helper function to parse the transform-origin attribute
+    //! @param transform_origin_attr The transform-origin attribute value.
+    //! @return The origin, (0,0) by default.
+    Point parseTransformOrigin(Slice transform_origin_attr)
+    {
+        const char* s = transform_origin_attr.begin();
+        const char* s_end = transform_origin_attr.end();
+        double x_origin, y_origin;
+        skip_separator(s, s_end);
+        if (!parse_number(s, s_end, x_origin))
+        {
+            return Point{0, 0};
+        }
+        skip_separator(s, s_end);
+        if (!parse_number(s, s_end, y_origin))
+        {
+            return Point{0, 0};
+        }
+        return Point{round_number(x_origin), round_number(y_origin)};
+    }
+    //! Helper function to parse transformations
+    //! The attribute is a list of transform functions (translate, rotate,
+    //! scale, matrix, skewX and skewY) which, as in SVG, apply from right
+    //! to left, around the transform origin. Whole-pixel arguments give
+    //! exact transformations, other ones go through a matrix.
+    //! @param transform_attr The transform attribute value.
+    //! @param transform_origin_attr The transform-origin attribute value.
+    //! @return The transformation.
+    Transform parseTransform(Slice transform_attr, Slice transform_origin_attr)
     {
-        if (transform_attr) 
+        Transform transform;
+        if (!transform_attr)
+        {
+            return transform;
+        }
+        struct Function
+        {
+            string name;
+            double args[6];
+            int count;
+        };
+        vector<Function> functions;
+        const char* s = transform_attr.begin();
+        const char* s_end = transform_attr.end();
+        while (true)
         {
-            string transform_str = transform_attr;
-            replace(transform_str.begin(), transform_str.end(), ',', ' ');
-            int angle;
-            int x_translate, y_translate;
-            if (sscanf(transform_str.c_str(), "translate(%d %d)", &x_translate, &y_translate) == 2) 
+            while (s < s_end && (*s == ' ' || *s == ',' || *s == '\t' || *s == '\n' || *s == '\r'))
             {
-                // Successfully parsed the translation values
-                Point t = Point{x_translate, y_translate};
-                element->translate(t);
+                s++;
             }
-            else if (sscanf(transform_str.c_str(), "rotate(%d)", &angle) == 1)
+            const char* name = s;
+            while (s < s_end && isalpha((unsigned char)*s))
             {
-                // Successfully parsed the rotation angle
-                Point origin;
-                if (transform_origin_attr)
+                s++;
+            }
+            Function function;
+            function.name.assign(name, s - name);
+            while (s < s_end && *s == ' ')
+            {
+                s++;
+            }
+            if (function.name.empty() || s == s_end || *s != '(')
+            {
+                break;
+            }
+            s++;
+            function.count = 0;
+            double value;
+            skip_separator(s, s_end);
+            while (parse_number(s, s_end, value))
+            {
+                if (function.count < 6)
                 {
-                    int x_origin, y_origin;
-                    if (sscanf(transform_origin_attr, "%d %d", &x_origin, &y_origin) == 2)
-                    {
-                        // Successfully parsed the transform-origin values
-                        origin = Point{x_origin, y_origin};
-                    }
+                    function.args[function.count++] = value;
+                }
+                skip_separator(s, s_end);
+            }
+            if (s == s_end || *s != ')')
+            {
+                break;
+            }
+            s++;
+            functions.push_back(function);
+        }
+        Point origin = parseTransformOrigin(transform_origin_attr);
+        // Apply a matrix around the transform origin.
+        auto matrix = [&transform, &origin](double a, double b, double c, double d, double e, double f)
+        {
+            transform.translate(Point{-origin.x, -origin.y});
+            transform.matrix(a, b, c, d, e, f);
+            transform.translate(origin);
+        };
+        for (auto it = functions.rbegin(); it != functions.rend(); ++it)
+        {
+            const Function& f = *it;
+            const double* v = f.args;
+            if (f.name == "translate" && f.count >= 1)
+            {
+                double ty = f.count >= 2 ? v[1] : 0;
+                if (whole_number(v[0]) && whole_number(ty))
+                {
+                    transform.translate(Point{(int)v[0], (int)ty});
                 }
                 else
                 {
-                    // No transform-origin attribute, use (0,0) as the default rotation origin
-                    origin = Point{0, 0};
+                    transform.matrix(1, 0, 0, 1, v[0], ty);
                 }
-                element->rotate(origin, angle);
             }
-            else if (sscanf(transform_str.c_str(), "scale(%d)", &x_translate) == 1)
+            else if (f.name == "rotate" && f.count >= 1)
             {
-                // Successfully parsed the scale factor
-                Point origin;
-                if (transform_origin_attr)
+                double cx = f.count >= 3 ? v[1] : 0;
+                double cy = f.count >= 3 ? v[2] : 0;
+                if (whole_number(v[0]) && whole_number(cx) && whole_number(cy))
                 {
-                    int x_origin, y_origin;
-                    if (sscanf(transform_origin_attr, "%d %d", &x_origin, &y_origin) == 2)
-                    {
-                        // Successfully parsed the transform-origin values
-                        origin = Point{x_origin, y_origin};
-                    }
+                    transform.rotate(Point{origin.x + (int)cx, origin.y + (int)cy}, (int)v[0]);
                 }
                 else
                 {
-                    // No transform-origin attribute, use (0,0) as the default scale origin
-                    origin = Point{0, 0};
+                    double angle = M_PI * v[0] / 180.0;
+                    double c = cos(angle), s = sin(angle);
+                    matrix(c, s, -s, c, cx - c * cx + s * cy, cy - s * cx - c * cy);
+                }
+            }
+            else if (f.name == "scale" && f.count >= 1)
+            {
+                double sy = f.count >= 2 ? v[1] : v[0];
+                if (whole_number(v[0]) && v[0] == sy)
+                {
+                    transform.scale(origin, (int)v[0]);
                 }
-                element->scale(origin, x_translate);
+                else
+                {
+                    matrix(v[0], 0, 0, sy, 0, 0);
+                }
+            }
+            else if (f.name == "matrix" && f.count == 6)
+            {
+                matrix(v[0], v[1], v[2], v[3], v[4], v[5]);
+            }
+            else if (f.name == "skewX" && f.count == 1)
+            {
+                matrix(1, 0, tan(M_PI * v[0] / 180.0), 1, 0, 0);
+            }
+            else if (f.name == "skewY" && f.count == 1)
+            {
+                matrix(1, tan(M_PI * v[0] / 180.0), 0, 1, 0, 0);
             }
         }
+        return transform;
     }
-    //! Helper function to handle the recurisve needs of the group element
-    //! @param group_elem The XML element representing the group.
-    //! @param group_elements The vector of SVG elements to add the group elements to.
-    //! @param id_map The map of SVG elements with id attributes.
-    void readGroup(XMLElement* group_elem, vector<SVGElement *>& group_elements, std::map<std::string, SVGElement*>& id_map)
+    //! Helper function to apply transformations to SVG elements
+    //! @param element The SVG element to apply the transformation to.
+    //! @param transform_attr The transform attribute value.
+    //! @param transform_origin_attr The transform-origin attribute value.
+    //! @param arena The arena owning the SVG elements.
+    void applyTransform(SVGElement* element, Slice transform_attr, Slice transform_origin_attr, Arena& arena)
     {
-        for (XMLElement* child = group_elem->FirstChildElement(); child != NULL; child = child->NextSiblingElement()) 
+        Transform transform = parseTransform(transform_attr, transform_origin_attr);
+        if (!transform.identity())
         {
-            // Process child elements here, similar to in readSVG
-            // If you encounter another "g", call readGroup recursively
-            const char* element_name = child->Name();
-            if (strcmp(element_name, "g") == 0)
+            element->set_transform(arena.create<Transform>(transform));
+        }
+    }
+    //! Helper function to parse the fill-rule attribute
+    //! @param fill_rule_attr The fill-rule attribute value.
+    //! @return The fill rule, nonzero by default as in SVG.
+    FillRule parseFillRule(Slice fill_rule_attr)
+    {
+        if (fill_rule_attr && fill_rule_attr == "evenodd")
+        {
+            return FillRule::EvenOdd;
+        }
+        return FillRule::NonZero;
+    }
+    //! Helper function to parse the points attribute
+    //! The coordinates are written straight into an array of the arena,
+    //! sized for the longest possible list and then trimmed.
+    //! @param points_attr The points attribute value, a list of
+    //! coordinates separated by white space and/or commas.
+    //! @param arena The arena owning the SVG elements.
+    //! @return The points.
+    Span<Point> parsePoints(Slice points_attr, Arena& arena)
+    {
+        Span<Point> points = arena.uninitialized<Point>(max_points(points_attr.size));
+        return arena.trim(points, parse_points(points_attr.begin(), points_attr.end(), points.data()));
+    }
+    //! Attributes read by readSVG, indexing Attributes::values.
+    enum Attribute
+    {
+        FILL,
+        STROKE,
+        FILL_RULE,
+        POINTS,
+        TRANSFORM,
+        TRANSFORM_ORIGIN,
+        ID,
+        HREF,
+        X,
+        Y,
+        WIDTH,
+        HEIGHT,
+        CX,
+        CY,
+        R,
+        RX,
+        RY,
+        X1,
+        Y1,
+        X2,
+        Y2,
+        ATTRIBUTE_COUNT
+    };
+    //! Names of the attributes, in the order of Attribute.
+    const char* const ATTRIBUTE_NAMES[ATTRIBUTE_COUNT] = {
+        "fill", "stroke", "fill-rule", "points", "transform", "transform-origin", "id", "href",
+        "x", "y", "width", "height", "cx", "cy", "r", "rx", "ry", "x1", "y1", "x2", "y2"};
+    //! Values of the attributes of a start tag, null if missing.
+    struct Attributes
+    {
+        Slice values[ATTRIBUTE_COUNT];
+
+        Slice operator[](Attribute attribute) const { return values[attribute]; }
+        //! Get a numeric attribute.
+        //! @param attribute The attribute.
+        //! @return The value rounded to a whole pixel, 0 if there is no
+        //! such attribute or if it is not a number.
+        int number(Attribute attribute) const
+        {
+            const char* s = values[attribute].begin();
+            const char* s_end = values[attribute].end();
+            double number;
+            skip_separator(s, s_end);
+            return parse_number(s, s_end, number) ? round_number(number) : 0;
+        }
+    };
+    //! Helper function to read the attributes of a start tag
+    //! The attributes are scanned once, each name being dispatched by its
+    //! hash (two names with the same hash would not compile); unknown
+    //! attributes are ignored.
+    //! @param reader The XML reader, positioned on the start tag.
+    //! @param attributes The attributes to fill in.
+    void readAttributes(const XMLReader& reader, Attributes& attributes)
+    {
+        for (Slice& value : attributes.values)
+        {
+            value = Slice{nullptr, 0};
+        }
+        for (size_t i = 0; i < reader.attribute_count(); i++)
+        {
+            Slice name = reader.attribute_name(i);
+            Attribute attribute;
+            switch (hash_name(name))
             {
-                vector<SVGElement *> nested_group_elements;
-                readGroup(child, nested_group_elements, id_map);
-                Group* nested_group = new Group(nested_group_elements);
-                applyTransform(nested_group, child->Attribute("transform"), child->Attribute("transform-origin"));
-                group_elements.push_back(nested_group);
-                if (child->Attribute("id"))
-                {
-                    id_map[child->Attribute("id")] = nested_group;
-                }
+            case hash_name("fill"): attribute = FILL; break;
+            case hash_name("stroke"): attribute = STROKE; break;
+            case hash_name("fill-rule"): attribute = FILL_RULE; break;
+            case hash_name("points"): attribute = POINTS; break;
+            case hash_name("transform"): attribute = TRANSFORM; break;
+            case hash_name("transform-origin"): attribute = TRANSFORM_ORIGIN; break;
+            case hash_name("id"): attribute = ID; break;
+            case hash_name("href"): attribute = HREF; break;
+            case hash_name("x"): attribute = X; break;
+            case hash_name("y"): attribute = Y; break;
+            case hash_name("width"): attribute = WIDTH; break;
+            case hash_name("height"): attribute = HEIGHT; break;
+            case hash_name("cx"): attribute = CX; break;
+            case hash_name("cy"): attribute = CY; break;
+            case hash_name("r"): attribute = R; break;
+            case hash_name("rx"): attribute = RX; break;
+            case hash_name("ry"): attribute = RY; break;
+            case hash_name("x1"): attribute = X1; break;
+            case hash_name("y1"): attribute = Y1; break;
+            case hash_name("x2"): attribute = X2; break;
+            case hash_name("y2"): attribute = Y2; break;
+            default: continue;
             }
-            // Process other elements as before
-            else if (strcmp(element_name, "ellipse") == 0)
+            // The first of repeated attributes is kept.
+            if (name == ATTRIBUTE_NAMES[attribute] && !attributes.values[attribute])
             {
-                // Create Color object from fill color string
-                Color fill(parse_color(child->Attribute("fill")));
-                // Create Point objects for center and radius
-                Point center = Point{child->IntAttribute("cx"), child->IntAttribute("cy")};
-                Point radius = Point{child->IntAttribute("rx"), child->IntAttribute("ry")};
-
-                // Create Ellipse object and add to SVG elements vector
-                Ellipse* ellipse = new Ellipse(fill, center, radius);
-
-                applyTransform(ellipse, child->Attribute("transform"), child->Attribute("transform-origin"));
-                group_elements.push_back(ellipse);
-                if (child->Attribute("id"))
-                {
-                    id_map[child->Attribute("id")] = ellipse;
-                }
+                attributes.values[attribute] = reader.attribute_value(i);
             }
-            else if (strcmp(element_name, "circle") == 0)
+        }
+    }
+    //! A use element read before the element it refers to.
+    struct ForwardUse
+    {
+        //! The use element.
+        Use* use;
+        //! The id it refers to, interned.
+        Slice id;
+    };
+    //! State shared by the element factories while a document is read.
+    struct ReadState
+    {
+        //! The XML reader.
+        const XMLReader& reader;
+        //! The arena owning the SVG elements.
+        Arena& arena;
+        //! The SVG elements with id attributes.
+        IdTable& ids;
+        //! The use elements to resolve at the end of the document.
+        vector<ForwardUse>& forward_uses;
+        //! The colors already parsed.
+        ColorCache& colors;
+    };
+    //! Helper function to keep an id for the rest of the document
+    //! @param id The id, read by the reader of state.
+    //! @param state The state of the document being read.
+    //! @return The id itself if it refers to the input, a copy in the arena otherwise.
+    Slice internId(Slice id, ReadState& state)
+    {
+        if (state.reader.persistent(id))
+        {
+            return id;
+        }
+        Span<char> copy = state.arena.copy(id.data, id.size);
+        return Slice{copy.data(), id.size};
+    }
+    //! Element factories, creating the SVG element of a start tag from
+    //! its attributes; they return nullptr if the element cannot be created.
+    SVGElement* createEllipse(const Attributes& a, ReadState& state)
+    {
+        Color fill(state.colors.parse(a[FILL].data, a[FILL].size));
+        Point center = Point{a.number(CX), a.number(CY)};
+        Point radius = Point{a.number(RX), a.number(RY)};
+        return state.arena.create<Ellipse>(fill, center, radius);
+    }
+    SVGElement* createCircle(const Attributes& a, ReadState& state)
+    {
+        Color fill(state.colors.parse(a[FILL].data, a[FILL].size));
+        Point center = Point{a.number(CX), a.number(CY)};
+        return state.arena.create<Circle>(fill, center, a.number(R));
+    }
+    SVGElement* createPolygon(const Attributes& a, ReadState& state)
+    {
+        Color fill(state.colors.parse(a[FILL].data, a[FILL].size));
+        Span<Point> points = parsePoints(a[POINTS], state.arena);
+        return state.arena.create<Polygon>(fill, points, parseFillRule(a[FILL_RULE]));
+    }
+    SVGElement* createRect(const Attributes& a, ReadState& state)
+    {
+        Color fill(state.colors.parse(a[FILL].data, a[FILL].size));
+        Point top_left = Point{a.number(X), a.number(Y)};
+        Point bottom_right = Point{top_left.x + a.number(WIDTH) - 1, top_left.y + a.number(HEIGHT) - 1};
+        return state.arena.create<Rect>(fill, top_left, bottom_right);
+    }
+    SVGElement* createPolyline(const Attributes& a, ReadState& state)
+    {
+        Color stroke(state.colors.parse(a[STROKE].data, a[STROKE].size));
+        Span<Point> points = parsePoints(a[POINTS], state.arena);
+        return state.arena.create<Polyline>(stroke, points);
+    }
+    SVGElement* createLine(const Attributes& a, ReadState& state)
+    {
+        Color stroke(state.colors.parse(a[STROKE].data, a[STROKE].size));
+        Point start = Point{a.number(X1), a.number(Y1)};
+        Point end = Point{a.number(X2), a.number(Y2)};
+        return state.arena.create<Line>(stroke, start, end);
+    }
+    SVGElement* createUse(const Attributes& a, ReadState& state)
+    {
+        // Remove '#' prefix from href
+        Slice id = a[HREF];
+        if (id && !id.empty() && id.data[0] == '#')
+        {
+            id = Slice{id.data + 1, id.size - 1};
+        }
+        // Share the original element if it was already read, otherwise
+        // resolve the reference at the end of the document
+        SVGElement* original = state.ids.find(id);
+        Use* use = state.arena.create<Use>(original);
+        if (original == nullptr)
+        {
+            state.forward_uses.push_back(ForwardUse{use, internId(id, state)});
+        }
+        return use;
+    }
+    //! Helper function to create the SVG element of a start tag, other than a group
+    //! The factory is selected by the hash of the tag name; new elements
+    //! only need a factory and an entry in the table.
+    //! @param name The tag name.
+    //! @param attributes The attributes of the tag.
+    //! @param state The state of the document being read.
+    //! @return The SVG element, or nullptr if the tag is not supported.
+    SVGElement* createElement(Slice name, const Attributes& attributes, ReadState& state)
+    {
+        struct Factory
+        {
+            uint32_t hash;
+            const char* name;
+            SVGElement* (*create)(const Attributes&, ReadState&);
+        };
+        // The hashes are computed by the compiler.
+        static const Factory factories[] = {
+            {hash_name("ellipse"), "ellipse", createEllipse},
+            {hash_name("circle"), "circle", createCircle},
+            {hash_name("polygon"), "polygon", createPolygon},
+            {hash_name("rect"), "rect", createRect},
+            {hash_name("polyline"), "polyline", createPolyline},
+            {hash_name("line"), "line", createLine},
+            {hash_name("use"), "use", createUse}};
+        uint32_t hash = hash_name(name);
+        const Factory* factory = nullptr;
+        for (const Factory& candidate : factories)
+        {
+            if (candidate.hash == hash && name == candidate.name)
             {
-                // Create Color object from fill color string
-                Color fill(parse_color(child->Attribute("fill")));
-                // Create Point objects for center and radius
-                Point center = Point{child->IntAttribute("cx"), child->IntAttribute("cy")};
-                int radius = child->IntAttribute("r");
-
-                // Create Circle object and add to SVG elements vector
-                Circle* circle = new Circle(fill, center, radius);
-
-                applyTransform(circle, child->Attribute("transform"), child->Attribute("transform-origin"));
-                group_elements.push_back(circle);
-                if (child->Attribute("id"))
-                {
-                    id_map[child->Attribute("id")] = circle;
-                }
+                factory = &candidate;
+                break;
             }
-            else if (strcmp(element_name, "polygon") == 0) 
+        }
+        if (factory == nullptr)
+        {
+            return nullptr;
+        }
+        SVGElement* element = factory->create(attributes, state);
+        if (element != nullptr)
+        {
+            applyTransform(element, attributes[TRANSFORM], attributes[TRANSFORM_ORIGIN], state.arena);
+        }
+        return element;
+    }
+    //! Helper function to read the children of an element
+    //! Elements are created as their tags are read, so the document
+    //! itself is never held in memory.
+    //! @param reader The XML reader, positioned after the start tag of the
+    //! element, or at the beginning of a range of its children.
+    //! @param state The state of the document being read.
+    //! @param elements Vector of SVG elements to add the children to.
+    void readChildren(XMLReader& reader, ReadState& state, vector<SVGElement *>& elements)
+    {
+        Attributes attributes;
+        // Groups being read, from the element (which is not a group)
+        // to the innermost one; a group is created when it is closed.
+        struct OpenGroup
+        {
+            vector<SVGElement *> elements;
+            Transform transform;
+            Slice id;
+        };
+        vector<OpenGroup> groups(1);
+        // Depth inside elements whose children are ignored
+        int skipped = 0;
+        while (true)
+        {
+            XMLReader::Event event = reader.next();
+            if (event == XMLReader::Event::Done)
+            {
+                break;
+            }
+            if (skipped > 0)
             {
-                // Create Color object from fill color string
-                Color fill(parse_color(child->Attribute("fill")));
-                // Create vector of Point objects for polygon points
-                vector<Point> points;
-                const char* points_str = child->Attribute("points");
-                string points_str_copy = points_str;
-                size_t pos = 0;
-                string token;
-                while ((pos = points_str_copy.find(" ")) != string::npos) {
-                    token = points_str_copy.substr(0, pos);
-                    size_t comma_pos = token.find(",");
-                    int x = stoi(token.substr(0, comma_pos));
-                    int y = stoi(token.substr(comma_pos + 1));
-                    points.push_back(Point{x, y});
-                    points_str_copy.erase(0, pos + 1);
+                skipped += event == XMLReader::Event::Start ? 1 : -1;
+                continue;
+            }
+            if (event == XMLReader::Event::Start)
+            {
+                readAttributes(reader, attributes);
+                if (reader.name() == "g")
+                {
+                    OpenGroup group;
+                    group.transform = parseTransform(attributes[TRANSFORM], attributes[TRANSFORM_ORIGIN]);
+                    group.id = attributes[ID] ? internId(attributes[ID], state) : Slice{nullptr, 0};
+                    groups.push_back(std::move(group));
+                    continue;
                 }
-                size_t comma_pos = points_str_copy.find(",");
-                int x = stoi(points_str_copy.substr(0, comma_pos));
-                int y = stoi(points_str_copy.substr(comma_pos + 1));
-                points.push_back(Point{x, y});
-
-                // Create Polygon object and add to SVG elements vector
-                Polygon* polygon = new Polygon(fill, points);
-
-                applyTransform(polygon, child->Attribute("transform"), child->Attribute("transform-origin"));
-                group_elements.push_back(polygon);
-                if (child->Attribute("id"))
+                SVGElement* element = createElement(reader.name(), attributes, state);
+                if (element != nullptr)
                 {
-                    id_map[child->Attribute("id")] = polygon;
+                    groups.back().elements.push_back(element);
+                    if (attributes[ID])
+                    {
+                        state.ids.insert(internId(attributes[ID], state), element);
+                    }
                 }
+                // The children of other elements are ignored
+                skipped = 1;
             }
-            else if (strcmp(element_name, "rect") == 0)
+            else if (groups.size() == 1)
             {
-                // Create Color object from fill color string
-                Color fill(parse_color(child->Attribute("fill")));
-                // Create Point objects for top left and bottom right corners
-                Point top_left = Point{child->IntAttribute("x"), child->IntAttribute("y")};
-                Point bottom_right = Point{child->IntAttribute("x") + child->IntAttribute("width") - 1, child->IntAttribute("y") + child->IntAttribute("height") - 1};
-                // Create Rect object and add to SVG elements vector
-                Rect* rect = new Rect(fill, top_left, bottom_right);
-
-                applyTransform(rect, child->Attribute("transform"), child->Attribute("transform-origin"));
-                group_elements.push_back(rect);
-                if (child->Attribute("id"))
-                {
-                    id_map[child->Attribute("id")] = rect;
-                }
+                // End of the element
+                break;
             }
-            else if (strcmp(element_name, "polyline") == 0)
+            else
             {
-                // Create Color object from stroke color string
-                Color stroke(parse_color(child->Attribute("stroke")));
-                // Create vector of Point objects for polyline points
-                vector<Point> points;
-                const char* points_str = child->Attribute("points");
-                string points_str_copy = points_str;
-                size_t pos = 0;
-                string token;
-                while ((pos = points_str_copy.find(" ")) != string::npos) {
-                    token = points_str_copy.substr(0, pos);
-                    size_t comma_pos = token.find(",");
-                    int x = stoi(token.substr(0, comma_pos));
-                    int y = stoi(token.substr(comma_pos + 1));
-                    points.push_back(Point{x, y});
-                    points_str_copy.erase(0, pos + 1);
+                OpenGroup& open = groups.back();
+                Group* group = state.arena.create<Group>(state.arena.copy(open.elements.data(), open.elements.size()));
+                if (!open.transform.identity())
+                {
+                    group->set_transform(state.arena.create<Transform>(open.transform));
                 }
-                size_t comma_pos = points_str_copy.find(",");
-                int x = stoi(points_str_copy.substr(0, comma_pos));
-                int y = stoi(points_str_copy.substr(comma_pos + 1));
-                points.push_back(Point{x, y});
-
-                // Create Polyline object and add to SVG elements vector
-                Polyline* polyline = new Polyline(stroke, points);
-
-                applyTransform(polyline, child->Attribute("transform"), child->Attribute("transform-origin"));
-                group_elements.push_back(polyline);
-                if (child->Attribute("id"))
+                if (open.id)
                 {
-                    id_map[child->Attribute("id")] = polyline;
+                    state.ids.insert(open.id, group);
                 }
+                groups.pop_back();
+                groups.back().elements.push_back(group);
             }
-            else if (strcmp(element_name, "line") == 0)
+        }
+        elements.insert(elements.end(), groups[0].elements.begin(), groups[0].elements.end());
+    }
+    //! Helper function to resolve the references of use elements to
+    //! elements read after them, once the whole document is read
+    //! A use element cannot draw itself, directly or through other ones.
+    //! @param forward_uses The use elements.
+    //! @param ids The SVG elements with id attributes.
+    void resolveForwardUses(const vector<ForwardUse>& forward_uses, const IdTable& ids)
+    {
+        for (const ForwardUse& forward : forward_uses)
+        {
+            SVGElement* original = ids.find(forward.id);
+            if (original == nullptr)
             {
-                // Create Color object from stroke color string
-                Color stroke(parse_color(child->Attribute("stroke")));
-
-                // Create Point objects for start and end points
-                Point start = Point{child->IntAttribute("x1"), child->IntAttribute("y1")};
-                Point end = Point{child->IntAttribute("x2"), child->IntAttribute("y2")};
-
-                // Create Line object
-                Line* line = new Line(stroke, start, end);
-
-                applyTransform(line, child->Attribute("transform"), child->Attribute("transform-origin"));
-                // Add to SVG elements vector
-                group_elements.push_back(line);
-                if (child->Attribute("id"))
-                {
-                    id_map[child->Attribute("id")] = line;
-                }
+                std::cerr << "Error: original element with id " << forward.id.str() << " not found." << std::endl;
             }
-            else if (strcmp(element_name, "use") == 0)
+            else if (original->draws(forward.use))
             {
-            // Get href attribute
-            const char* href = child->Attribute("href");
-            // Remove '#' prefix from href
-            std::string id = href + 1;
-            // Find original element in map
-            SVGElement* original = id_map[id];
-            // Clone original element
-            if (original != nullptr) {
-                // Clone original element
-                SVGElement* clone = original->clone();
-                // Apply transformations to clone
-                applyTransform(clone, child->Attribute("transform"), child->Attribute("transform-origin"));
-                // Add clone to SVG elements vector
-                group_elements.push_back(clone);
-                // If the use element has an id, add the clone to the id_map
-                if (child->Attribute("id")) {
-                    id_map[child->Attribute("id")] = clone;
-                }
-                } else {
-                    // Handle the error: the original element was not found in the map
-                    std::cerr << "Error: original element with id " << id << " not found." << std::endl;
-                }
+                std::cerr << "Error: element with id " << forward.id.str() << " refers to itself." << std::endl;
+            }
+            else
+            {
+                forward.use->resolve(original, false);
             }
         }
     }
-
-    void readSVG(const string& svg_file, Point& dimensions, vector<SVGElement *>& svg_elements)
+    //! Elements read from a range of the children of the root element
+    //! by a worker thread, with their own arena and ids.
+    struct DocumentPart
+    {
+        Arena arena;
+        vector<SVGElement *> elements;
+        IdTable ids;
+        vector<ForwardUse> forward_uses;
+        //! Exception thrown while reading the range, if any.
+        exception_ptr error;
+    };
+    //! Helper function to read ranges of the children of the root element
+    //! in parallel, one thread per range, and merge them in document order
+    //! The references of use elements to elements of earlier ranges are
+    //! resolved as if the ranges had been read one after the other.
+    //! @param ranges The ranges, in document order.
+    //! @param svg_elements Vector of SVG elements to add the elements to.
+    //! @param arena The arena owning the SVG elements, which takes over
+    //! the memory of the ranges.
+    void readParts(const vector<Slice>& ranges, vector<SVGElement *>& svg_elements, Arena& arena)
     {
-        XMLDocument doc;
-        XMLError r = doc.LoadFile(svg_file.c_str());
-        if (r != XML_SUCCESS)
+        vector<unique_ptr<DocumentPart>> parts;
+        for (size_t i = 0; i < ranges.size(); i++)
         {
-            throw runtime_error("Unable to load " + svg_file);
+            parts.emplace_back(new DocumentPart());
         }
-        XMLElement *xml_elem = doc.RootElement();
-
-        dimensions.x = xml_elem->IntAttribute("width");
-        dimensions.y = xml_elem->IntAttribute("height");
-
-        // Map to store elements with id attribute
-        std::map<std::string, SVGElement*> id_map;
-        
-        // Code to traverse the XML child nodes and parse the SVG elements that are defined
-        for (XMLElement* child = xml_elem->FirstChildElement(); child != NULL; child = child->NextSiblingElement()) {
-
-            SVGElement* element = nullptr;
-            const char* element_name = child->Name();
-            if (strcmp(element_name, "ellipse") == 0)
+        auto read = [&](size_t i)
+        {
+            DocumentPart& part = *parts[i];
+            try
             {
-                // Create Color object from fill color string
-                Color fill(parse_color(child->Attribute("fill")));
-                // Create Point objects for center and radius
-                Point center = Point{child->IntAttribute("cx"), child->IntAttribute("cy")};
-                Point radius = Point{child->IntAttribute("rx"), child->IntAttribute("ry")};
-
-                // Create Ellipse object and add to SVG elements vector
-                Ellipse* ellipse = new Ellipse(fill, center, radius);
-
-                applyTransform(ellipse, child->Attribute("transform"), child->Attribute("transform-origin"));
-                svg_elements.push_back(ellipse);
-                if (child->Attribute("id"))
-                {
-                    id_map[child->Attribute("id")] = ellipse;
-                }
-            
+                XMLReader reader(ranges[i].data, ranges[i].size);
+                ColorCache colors;
+                ReadState state = {reader, part.arena, part.ids, part.forward_uses, colors};
+                readChildren(reader, state, part.elements);
             }
-            else if (strcmp(element_name, "circle") == 0)
+            catch (...)
             {
-                // Create Color object from fill color string
-                Color fill(parse_color(child->Attribute("fill")));
-                // Create Point objects for center and radius
-                Point center = Point{child->IntAttribute("cx"), child->IntAttribute("cy")};
-                int radius = child->IntAttribute("r");
-
-                // Create Circle object and add to SVG elements vector
-                Circle* circle = new Circle(fill, center, radius);
-
-                applyTransform(circle, child->Attribute("transform"), child->Attribute("transform-origin"));
-                svg_elements.push_back(circle);
-                if (child->Attribute("id"))
-                {
-                    id_map[child->Attribute("id")] = circle;
-                }
+                part.error = current_exception();
             }
-            else if (strcmp(element_name, "polygon") == 0) 
+        };
+        vector<thread> pool;
+        for (size_t i = 1; i < parts.size(); i++)
+        {
+            pool.emplace_back(read, i);
+        }
+        read(0);
+        for (thread& t : pool)
+        {
+            t.join();
+        }
+        IdTable ids;
+        vector<ForwardUse> forward_uses;
+        for (const unique_ptr<DocumentPart>& part : parts)
+        {
+            if (part->error)
             {
-                // Create Color object from fill color string
-                Color fill(parse_color(child->Attribute("fill")));
-                // Create vector of Point objects for polygon points
-                vector<Point> points;
-                const char* points_str = child->Attribute("points");
-                string points_str_copy = points_str;
-                size_t pos = 0;
-                string token;
-                while ((pos = points_str_copy.find(" ")) != string::npos) {
-                    token = points_str_copy.substr(0, pos);
-                    size_t comma_pos = token.find(",");
-                    int x = stoi(token.substr(0, comma_pos));
-                    int y = stoi(token.substr(comma_pos + 1));
-                    points.push_back(Point{x, y});
-                    points_str_copy.erase(0, pos + 1);
-                }
-                size_t comma_pos = points_str_copy.find(",");
-                int x = stoi(points_str_copy.substr(0, comma_pos));
-                int y = stoi(points_str_copy.substr(comma_pos + 1));
-                points.push_back(Point{x, y});
-
-                // Create Polygon object and add to SVG elements vector
-                Polygon* polygon = new Polygon(fill, points);
-
-                applyTransform(polygon, child->Attribute("transform"), child->Attribute("transform-origin"));
-                svg_elements.push_back(polygon);
-                if (child->Attribute("id"))
-                {
-                    id_map[child->Attribute("id")] = polygon;
-                }
+                rethrow_exception(part->error);
             }
-            else if (strcmp(element_name, "rect") == 0)
+            // References not found in their own range refer to the
+            // elements of earlier ranges if there are some.
+            for (const ForwardUse& forward : part->forward_uses)
             {
-                // Create Color object from fill color string
-                Color fill(parse_color(child->Attribute("fill")));
-                // Create Point objects for top left and bottom right corners
-                Point top_left = Point{child->IntAttribute("x"), child->IntAttribute("y")};
-                Point bottom_right = Point{child->IntAttribute("x") + child->IntAttribute("width") - 1, child->IntAttribute("y") + child->IntAttribute("height") - 1};
-                // Create Rect object and add to SVG elements vector
-                Rect* rect = new Rect(fill, top_left, bottom_right);
-
-                applyTransform(rect, child->Attribute("transform"), child->Attribute("transform-origin"));
-                svg_elements.push_back(rect);
-                if (child->Attribute("id"))
+                SVGElement* original = ids.find(forward.id);
+                if (original != nullptr)
                 {
-                    id_map[child->Attribute("id")] = rect;
+                    forward.use->resolve(original, true);
                 }
-            }
-            else if (strcmp(element_name, "polyline") == 0)
-            {
-                // Create Color object from stroke color string
-                Color stroke(parse_color(child->Attribute("stroke")));
-                // Create vector of Point objects for polyline points
-                vector<Point> points;
-                const char* points_str = child->Attribute("points");
-                string points_str_copy = points_str;
-                size_t pos = 0;
-                string token;
-                while ((pos = points_str_copy.find(" ")) != string::npos) {
-                    token = points_str_copy.substr(0, pos);
-                    size_t comma_pos = token.find(",");
-                    int x = stoi(token.substr(0, comma_pos));
-                    int y = stoi(token.substr(comma_pos + 1));
-                    points.push_back(Point{x, y});
-                    points_str_copy.erase(0, pos + 1);
-                }
-                size_t comma_pos = points_str_copy.find(",");
-                int x = stoi(points_str_copy.substr(0, comma_pos));
-                int y = stoi(points_str_copy.substr(comma_pos + 1));
-                points.push_back(Point{x, y});
-
-                // Create Polyline object and add to SVG elements vector
-                Polyline* polyline = new Polyline(stroke, points);
-
-                applyTransform(polyline, child->Attribute("transform"), child->Attribute("transform-origin"));
-                svg_elements.push_back(polyline);
-                if (child->Attribute("id"))
+                else
                 {
-                    id_map[child->Attribute("id")] = polyline;
+                    forward_uses.push_back(forward);
                 }
             }
-            else if (strcmp(element_name, "line") == 0)
-            {
-                // Create Color object from stroke color string
-                Color stroke(parse_color(child->Attribute("stroke")));
-
-                // Create Point objects for start and end points
-                Point start = Point{child->IntAttribute("x1"), child->IntAttribute("y1")};
-                Point end = Point{child->IntAttribute("x2"), child->IntAttribute("y2")};
+            ids.insert(part->ids);
+            svg_elements.insert(svg_elements.end(), part->elements.begin(), part->elements.end());
+            arena.adopt(part->arena);
+        }
+        resolveForwardUses(forward_uses, ids);
+    }
+    //! Helper function to read an SVG document
+    //! @param reader The XML reader, positioned before the root element.
+    //! @param dimensions Dimensions of the SVG document.
+    //! @param svg_elements Vector of SVG elements to add the elements to.
+    //! @param arena The arena owning the SVG elements.
+    //! @param threads Number of threads reading large documents from a
+    //! block of memory, 0 for one per hardware thread.
+    void readDocument(XMLReader& reader, Point& dimensions, vector<SVGElement *>& svg_elements, Arena& arena,
+                      unsigned threads)
+    {
+        if (reader.next() != XMLReader::Event::Start)
+        {
+            throw runtime_error("Malformed XML: no root element");
+        }
+        Attributes attributes;
+        readAttributes(reader, attributes);
+        dimensions.x = attributes.number(WIDTH);
+        dimensions.y = attributes.number(HEIGHT);
+        if (dimensions.x <= 0 || dimensions.y <= 0)
+        {
+            throw runtime_error("Invalid SVG document: width and height must be positive");
+        }
 
-                // Create Line object
-                Line* line = new Line(stroke, start, end);
+        if (threads == 0)
+        {
+            threads = max(thread::hardware_concurrency(), 1u);
+        }
+        // Ranges of the children of the root element, large enough for
+        // the threads to be worth starting.
+        const size_t MIN_RANGE_SIZE = 256 * 1024;
+        vector<Slice> ranges = reader.split_children(threads, MIN_RANGE_SIZE);
+        if (ranges.size() > 1)
+        {
+            readParts(ranges, svg_elements, arena);
+            return;
+        }
+        IdTable ids;
+        vector<ForwardUse> forward_uses;
+        ColorCache colors;
+        ReadState state = {reader, arena, ids, forward_uses, colors};
+        readChildren(reader, state, svg_elements);
+        resolveForwardUses(forward_uses, ids);
+    }
 
-                applyTransform(line, child->Attribute("transform"), child->Attribute("transform-origin"));
-                // Add to SVG elements vector
-                svg_elements.push_back(line);
-                if (child->Attribute("id"))
+    namespace
+    {
+        //! Read-only mapping of a whole file in memory.
+        class MappedFile
+        {
+        public:
+            //! Constructor, mapping a file if possible.
+            //! @param fd Open file descriptor, which can be closed afterwards.
+            explicit MappedFile(int fd) : data_(nullptr), size_(0)
+            {
+                struct stat st;
+                if (fstat(fd, &st) != 0 || !S_ISREG(st.st_mode) || st.st_size == 0)
                 {
-                    id_map[child->Attribute("id")] = line;
+                    return;
                 }
-            }
-            else if (strcmp(element_name, "g") == 0)
-            {
-                vector<SVGElement *> group_elements;
-                readGroup(child, group_elements, id_map);
-                Group* group = new Group(group_elements);
-                applyTransform(group, child->Attribute("transform"), child->Attribute("transform-origin"));
-                svg_elements.push_back(group);
-                if (child->Attribute("id"))
+                void* data = mmap(nullptr, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+                if (data == MAP_FAILED)
                 {
-                    id_map[child->Attribute("id")] = group;
+                    return;
                 }
+                // The file is read once, from beginning to end.
+                madvise(data, st.st_size, MADV_SEQUENTIAL);
+                data_ = (const char*)data;
+                size_ = st.st_size;
             }
-            else if (strcmp(element_name, "use") == 0)
+            ~MappedFile()
             {
-            // Get href attribute
-            const char* href = child->Attribute("href");
-            // Remove '#' prefix from href
-            std::string id = href + 1;
-            // Find original element in map
-            SVGElement* original = id_map[id];
-            // Clone original element
-            if (original != nullptr) {
-                // Clone original element
-                SVGElement* clone = original->clone();
-                // Apply transformations to clone
-                applyTransform(clone, child->Attribute("transform"), child->Attribute("transform-origin"));
-                // Add clone to SVG elements vector
-                svg_elements.push_back(clone);
-                // If the use element has an id, add the clone to the id_map
-                if (child->Attribute("id")) {
-                    id_map[child->Attribute("id")] = clone;
-                }
-                } else {
-                    // Handle the error: the original element was not found in the map
-                    std::cerr << "Error: original element with id " << id << " not found." << std::endl;
+                if (data_ != nullptr)
+                {
+                    munmap((void*)data_, size_);
                 }
             }
-            else if (element != nullptr)
-            {
-                svg_elements.push_back(element);
-            }
+            MappedFile(const MappedFile&) = delete;
+            MappedFile& operator=(const MappedFile&) = delete;
+            //! @return First byte, nullptr if the file could not be mapped.
+            const char* data() const { return data_; }
+            //! @return Number of bytes.
+            size_t size() const { return size_; }
+
+        private:
+            const char* data_;
+            size_t size_;
+        };
+    }
+
+    void readSVG(const string& svg_file, Point& dimensions, vector<SVGElement *>& svg_elements, Arena& arena,
+                 unsigned threads)
+    {
+        unique_ptr<FILE, int (*)(FILE*)> file(fopen(svg_file.c_str(), "rb"), fclose);
+        if (!file)
+        {
+            throw runtime_error("Unable to load " + svg_file);
+        }
+        // Files that cannot be mapped (such as pipes) are read in chunks.
+        MappedFile mapped(fileno(file.get()));
+        unique_ptr<XMLReader> reader(mapped.data() != nullptr ? new XMLReader(mapped.data(), mapped.size())
+                                                              : new XMLReader(file.get()));
+        try
+        {
+            readDocument(*reader, dimensions, svg_elements, arena, threads);
+        }
+        catch (const runtime_error& e)
+        {
+            throw runtime_error("Unable to load " + svg_file + ": " + e.what());
+        }
+    }
+    void readSVG(const char* svg_data, size_t svg_size, Point& dimensions, vector<SVGElement *>& svg_elements,
+                 Arena& arena, unsigned threads)
+    {
+        XMLReader reader(svg_data, svg_size);
+        try
+        {
+            readDocument(reader, dimensions, svg_elements, arena, threads);
+        }
+        catch (const runtime_error& e)
+        {
+            throw runtime_error(string("Unable to load SVG data: ") + e.what());
         }
     }
-}
\ No newline at end of file
+}
@@ -0,0 +1,218 @@
+#include <algorithm>
+#include <atomic>
+#include <functional>
+#include <thread>
+#include <vector>
+#include "SVGElements.hpp"
+
+namespace svg
+{
+    RenderStats::RenderStats()
+        : occluded_pixels(0), culled_elements(0)
+    {
+    }
+
+    void compile(const std::vector<SVGElement *> &svg_elements, DisplayList &list)
+    {
+        for (const SVGElement *element : svg_elements)
+        {
+            element->compile(list);
+        }
+    }
+
+    namespace
+    {
+        //! Bytes of the bands drawn when the band height is automatic
+        //! and the image is too large.
+        const size_t AUTO_BAND_SIZE = 16 << 20;
+        //! Largest image drawn at once when the band height is automatic.
+        const size_t MAX_IMAGE_SIZE = 256 << 20;
+
+        //! Draws some commands of a display list, as render does.
+        //! @param subset Indices of the commands, in order, or nullptr
+        //! for all of them.
+        void render_commands(const DisplayList &list, const std::vector<size_t> *subset,
+                             PNGImage &img, const ConvertOptions &options, RenderStats *stats)
+        {
+            // Only the clipping region is tiled, which is a band of
+            // rows of the image for bands.
+            const BBox &area = img.clip();
+            const int tile = std::max(options.tile_size, 1);
+            const int tiles_x = (area.max.x - area.min.x + tile - 1) / tile;
+            const int tiles_y = (area.max.y - area.min.y + tile - 1) / tile;
+            const size_t n_tiles = (size_t)tiles_x * tiles_y;
+
+            // Bin every command in the tiles its bounding box overlaps.
+            // Commands are visited in order, so each bin keeps that order.
+            const std::vector<DrawCommand> &commands = list.commands();
+            const size_t n_commands = subset != nullptr ? subset->size() : commands.size();
+            std::vector<std::vector<size_t>> bins(n_tiles);
+            for (size_t k = 0; k < n_commands; k++)
+            {
+                size_t i = subset != nullptr ? (*subset)[k] : k;
+                BBox box = img.drawn_box(commands[i].bbox);
+                if (box.empty())
+                {
+                    continue;
+                }
+                for (int ty = (box.min.y - area.min.y) / tile; ty <= (box.max.y - area.min.y - 1) / tile; ty++)
+                {
+                    for (int tx = (box.min.x - area.min.x) / tile; tx <= (box.max.x - area.min.x - 1) / tile; tx++)
+                    {
+                        bins[(size_t)ty * tiles_x + tx].push_back(i);
+                    }
+                }
+            }
+
+            // All shapes are opaque, so when drawing them back to front
+            // the pixels already set by later shapes are never written,
+            // and shapes covered completely are skipped.
+            // Blended anti-aliased edges need the front to back order.
+            std::vector<unsigned char> mask;
+            if (options.occlusion_culling && !img.antialias())
+            {
+                mask.assign((size_t)img.width() * (area.max.y - area.min.y), 0);
+                img.set_occlusion_mask(mask.data());
+            }
+
+            // Tiles are handed out to the workers one at a time.
+            std::atomic<size_t> next_tile(0);
+            std::atomic<unsigned long long> occluded_pixels(0);
+            std::atomic<size_t> culled_elements(0);
+            auto worker = [&]()
+            {
+                for (size_t t = next_tile++; t < n_tiles; t = next_tile++)
+                {
+                    if (bins[t].empty())
+                    {
+                        continue;
+                    }
+                    int tx = area.min.x + (int)(t % tiles_x) * tile;
+                    int ty = area.min.y + (int)(t / tiles_x) * tile;
+                    PNGImage view(img, {{tx, ty}, {tx + tile, ty + tile}});
+                    if (!view.back_to_front())
+                    {
+                        for (size_t i : bins[t])
+                        {
+                            list.draw(commands[i], view);
+                        }
+                        continue;
+                    }
+                    size_t culled = 0;
+                    for (auto it = bins[t].rbegin(); it != bins[t].rend(); ++it)
+                    {
+                        if (view.occluded(commands[*it].bbox))
+                        {
+                            culled++;
+                            continue;
+                        }
+                        list.draw(commands[*it], view);
+                    }
+                    occluded_pixels += view.occluded_pixels();
+                    culled_elements += culled;
+                }
+            };
+
+            unsigned threads = options.threads;
+            if (threads == 0)
+            {
+                threads = std::max(std::thread::hardware_concurrency(), 1u);
+            }
+            threads = (unsigned)std::min<size_t>(threads, n_tiles);
+            std::vector<std::thread> pool;
+            for (unsigned i = 1; i < threads; i++)
+            {
+                pool.emplace_back(worker);
+            }
+            worker();
+            for (std::thread &t : pool)
+            {
+                t.join();
+            }
+            img.set_occlusion_mask(nullptr);
+            if (stats != nullptr)
+            {
+                stats->occluded_pixels = occluded_pixels;
+                stats->culled_elements = culled_elements;
+            }
+        }
+    }
+
+    void render(const DisplayList &list, PNGImage &img, const ConvertOptions &options,
+                RenderStats *stats)
+    {
+        render_commands(list, nullptr, img, options, stats);
+    }
+
+    int band_rows(int width, int height, const ConvertOptions &options)
+    {
+        if (options.band_height > 0)
+        {
+            return std::max(std::min(options.band_height, height), 1);
+        }
+        const size_t stride = (size_t)width * (options.format == PixelFormat::RGB8 ? 3 : 4);
+        if (stride * height <= MAX_IMAGE_SIZE)
+        {
+            return std::max(height, 1);
+        }
+        return (int)std::max<size_t>(AUTO_BAND_SIZE / stride, 1);
+    }
+
+    void render_bands(const DisplayList &list, int width, int height, const ConvertOptions &options,
+                      const std::function<void(PNGImage &)> &done, RenderStats *stats)
+    {
+        const int rows = band_rows(width, height, options);
+        const int n_bands = (height + rows - 1) / rows;
+
+        // Bin every command in the bands its bounding box overlaps,
+        // as render bins them in tiles (anti-aliased shapes reach
+        // 2 pixels out of their box, see PNGImage::drawn_box).
+        const std::vector<DrawCommand> &commands = list.commands();
+        const int margin = options.antialias ? 2 : 0;
+        std::vector<std::vector<size_t>> bins(n_bands > 1 ? n_bands : 0);
+        for (size_t i = 0; i < commands.size() && n_bands > 1; i++)
+        {
+            const BBox &box = commands[i].bbox;
+            int y0 = std::max(box.min.y - margin, 0);
+            int y1 = std::min(box.max.y + margin, height);
+            if (box.empty() || y0 >= y1)
+            {
+                continue;
+            }
+            for (int b = y0 / rows; b <= (y1 - 1) / rows; b++)
+            {
+                bins[b].push_back(i);
+            }
+        }
+
+        if (stats != nullptr)
+        {
+            *stats = RenderStats();
+        }
+        const Color white = {255, 255, 255};
+        for (int b = 0; b < n_bands; b++)
+        {
+            PNGImage band(width, height, b * rows, std::min((b + 1) * rows, height), white, options.format);
+            if (options.format == PixelFormat::RGBA8)
+            {
+                // Transparent white, so that the image looks the same
+                // as the RGB one over a white page.
+                band.clear(white, 0);
+            }
+            band.set_antialias(options.antialias);
+            RenderStats band_stats;
+            render_commands(list, n_bands > 1 ? &bins[b] : nullptr, band, options, &band_stats);
+            // The commands of the band are not needed anymore.
+            if (n_bands > 1)
+            {
+                std::vector<size_t>().swap(bins[b]);
+            }
+            if (stats != nullptr)
+            {
+                stats->occluded_pixels += band_stats.occluded_pixels;
+                stats->culled_elements += band_stats.culled_elements;
+            }
+            done(band);
+        }
+    }
+}
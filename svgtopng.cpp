@@ -1,17 +1,166 @@
 #include "SVGElements.hpp"
+#include <algorithm>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
 #include <iostream>
+#include <memory>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+namespace
+{
+    //! Read a whole file.
+    //! @param name File name, "-" for the standard input.
+    //! @return The bytes of the file.
+    std::string read_file(const std::string &name)
+    {
+        std::unique_ptr<FILE, int (*)(FILE *)> file(name == "-" ? stdin : ::fopen(name.c_str(), "rb"),
+                                                   [](FILE *f)
+                                                   { return f == stdin ? 0 : ::fclose(f); });
+        if (!file)
+        {
+            throw std::runtime_error("Unable to load " + name);
+        }
+        std::string data;
+        char buffer[65536];
+        size_t n;
+        while ((n = ::fread(buffer, 1, sizeof(buffer), file.get())) > 0)
+        {
+            data.append(buffer, n);
+        }
+        if (::ferror(file.get()))
+        {
+            throw std::runtime_error("Unable to load " + name);
+        }
+        return data;
+    }
+
+    //! Write a whole file.
+    //! @param name File name, "-" for the standard output.
+    //! @param data The bytes of the file.
+    void write_file(const std::string &name, const std::vector<unsigned char> &data)
+    {
+        std::unique_ptr<FILE, int (*)(FILE *)> file(name == "-" ? stdout : ::fopen(name.c_str(), "wb"),
+                                                   [](FILE *f)
+                                                   { return f == stdout ? ::fflush(f) : ::fclose(f); });
+        if (!file || ::fwrite(data.data(), 1, data.size(), file.get()) != data.size() ||
+            ::fflush(file.get()) != 0)
+        {
+            throw std::runtime_error(name + ": could not save image!");
+        }
+    }
+}
 
 int main(int argc, char **argv)
 {
-    if (argc != 3)
+    svg::ConvertOptions options;
+    bool show_stats = false;
+    int arg = 1;
+    for (; arg < argc && argv[arg][0] == '-' && argv[arg][1] != '\0'; arg++)
+    {
+        if (strcmp(argv[arg], "-a") == 0)
+        {
+            options.antialias = true;
+        }
+        else if (strcmp(argv[arg], "-b") == 0 && arg + 1 < argc)
+        {
+            options.band_height = std::max(atoi(argv[++arg]), 0);
+        }
+        else if (strcmp(argv[arg], "-f") == 0 && arg + 1 < argc)
+        {
+            arg++;
+            if (strcmp(argv[arg], "rgba") == 0)
+            {
+                options.format = svg::PixelFormat::RGBA8;
+            }
+            else if (strcmp(argv[arg], "rgbx") == 0)
+            {
+                options.format = svg::PixelFormat::RGBX8;
+            }
+            else if (strcmp(argv[arg], "rgb") == 0)
+            {
+                options.format = svg::PixelFormat::RGB8;
+            }
+            else
+            {
+                break;
+            }
+        }
+        else if (strcmp(argv[arg], "-n") == 0)
+        {
+            options.occlusion_culling = false;
+        }
+        else if (strcmp(argv[arg], "-s") == 0)
+        {
+            show_stats = true;
+        }
+        else if (strcmp(argv[arg], "-j") == 0 && arg + 1 < argc)
+        {
+            options.threads = (unsigned)atoi(argv[++arg]);
+        }
+        else if (strcmp(argv[arg], "-p") == 0 && arg + 1 < argc)
+        {
+            arg++;
+            const char *names[] = {"none", "sub", "up", "average", "paeth", "adaptive"};
+            int i = 0;
+            while (i < 6 && strcmp(argv[arg], names[i]) != 0)
+            {
+                i++;
+            }
+            if (i == 6)
+            {
+                break;
+            }
+            options.filter = (svg::PNGFilter)i;
+        }
+        else if (strcmp(argv[arg], "-z") == 0 && arg + 1 < argc)
+        {
+            options.compression_level = std::min(std::max(atoi(argv[++arg]), 0), 9);
+        }
+        else
+        {
+            break;
+        }
+    }
+    if (argc - arg != 2)
     {
-        std::cout << "Usage: svgtopng in_file.svg out_file.png" << std::endl;
+        std::cout << "Usage: svgtopng [-a] [-b rows] [-f format] [-j threads] [-n] [-p filter] [-s] [-z level] in_file.svg out_file.png" << std::endl
+                  << "  -a          draw anti-aliased shapes" << std::endl
+                  << "  -b rows     draw and write the image in bands of rows (default: only if larger than 256 MiB)" << std::endl
+                  << "  -f format   pixel format: rgb (default), rgbx, or rgba (transparent background)" << std::endl
+                  << "  -j threads  number of reading and rendering threads (default: one per core)" << std::endl
+                  << "  -n          draw every element, even hidden ones" << std::endl
+                  << "  -p filter   PNG row filter: none, sub, up (default), average, paeth, or adaptive" << std::endl
+                  << "  -s          print the number of hidden pixels not written" << std::endl
+                  << "  -z level    PNG compression level, from 0 (fastest) to 9 (smallest, default: 6)" << std::endl
+                  << "Use - as in_file.svg to read standard input, and as out_file.png to write standard output." << std::endl;
     }
     else
     {
-        std::cout << "Performing conversion ... " << argv[1] << " --> " << argv[2] << std::endl;
-        svg::convert(argv[1], argv[2]);
-        std::cout << "Done!" << std::endl;
+        const std::string in_file = argv[arg], out_file = argv[arg + 1];
+        // Messages go to the standard error when the image goes to the standard output.
+        std::ostream &log = out_file == "-" ? std::cerr : std::cout;
+        log << "Performing conversion ... " << in_file << " --> " << out_file << std::endl;
+        svg::RenderStats stats;
+        if (in_file == "-" || out_file == "-")
+        {
+            const std::string svg = read_file(in_file);
+            std::vector<unsigned char> png;
+            svg::convert(svg.data(), svg.size(), png, options, &stats);
+            write_file(out_file, png);
+        }
+        else
+        {
+            svg::convert(in_file, out_file, options, &stats);
+        }
+        log << "Done!" << std::endl;
+        if (show_stats)
+        {
+            log << "Hidden pixels not written: " << stats.occluded_pixels << std::endl
+                << "Hidden elements not drawn: " << stats.culled_elements << std::endl;
+        }
     }
     return 0;
-}
\ No newline at end of file
+}
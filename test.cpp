@@ -1,6 +1,8 @@
 
 // Project file headers
 #include "SVGElements.hpp"
+#define STBI_ONLY_PNG
+#include "external/stb/stb_image.h"
 
 // C++ library headers
 #include <algorithm>
@@ -11,7 +13,10 @@
 #include <string>
 #include <vector>
 #include <iterator>
+#include <memory>
 #include <fstream>
+#include <functional>
+#include <stdexcept>
 using namespace std;
 
 // POSIX headers
@@ -33,12 +38,205 @@ namespace svg
         int failed_tests = 0;
         FILE *log_stream;
 
+        // Conversion options of a test, given by the prefixes of its id:
+        // aa_ for anti-aliasing, rgba_ and rgbx_ for the pixel formats
+        // (the alpha channel of rgba_ tests is compared too).
+        static ConvertOptions test_options(const string &id)
+        {
+            ConvertOptions options;
+            size_t at = 0;
+            while (true)
+            {
+                if (id.compare(at, 3, "aa_") == 0)
+                {
+                    options.antialias = true;
+                    at += 3;
+                }
+                else if (id.compare(at, 5, "rgba_") == 0)
+                {
+                    options.format = PixelFormat::RGBA8;
+                    at += 5;
+                }
+                else if (id.compare(at, 5, "rgbx_") == 0)
+                {
+                    options.format = PixelFormat::RGBX8;
+                    at += 5;
+                }
+                else
+                {
+                    break;
+                }
+            }
+            return options;
+        }
+
+        // Compare two PNG files decoded as RGBA, from a channel on:
+        // 0 to compare the whole pixels, 3 for the alpha channel only.
+        static bool same_channels(const string &exp_file, const string &out_file, int first)
+        {
+            int w1, h1, w2, h2, channels;
+            unique_ptr<unsigned char, void (*)(void *)>
+                img1(stbi_load(exp_file.c_str(), &w1, &h1, &channels, 4), stbi_image_free),
+                img2(stbi_load(out_file.c_str(), &w2, &h2, &channels, 4), stbi_image_free);
+            if (!img1 || !img2 || w1 != w2 || h1 != h2)
+            {
+                cout << "Unable to compare the images" << endl;
+                return false;
+            }
+            for (size_t i = 0; i < (size_t)w1 * h1 * 4; i++)
+            {
+                if ((int)(i % 4) >= first && img1.get()[i] != img2.get()[i])
+                {
+                    cout << "pixel (" << i / 4 % w1 << ' ' << i / 4 / w1 << "): expected channel "
+                         << i % 4 << ' ' << (int)img1.get()[i] << " got " << (int)img2.get()[i] << endl;
+                    return false;
+                }
+            }
+            return true;
+        }
+
+        // Conversion of an input with other options or by other means,
+        // checked against its conversion with the options of its id.
+        struct Variant
+        {
+            // Id of the input.
+            string id;
+            // Name of the variant, appended to the id.
+            string name;
+            // Convert the input to a file, given the options of its id.
+            function<void(const string &svg_file, const string &out_file, ConvertOptions options)> run;
+            // Whether the files must be equal, and not only their pixels.
+            bool same_bytes;
+        };
+
+        vector<Variant> variants() const
+        {
+            // Converting a document held in memory to a PNG file in memory.
+            auto in_memory = [](const string &svg_file, const string &out_file, ConvertOptions options)
+            {
+                ifstream in(svg_file, ios::binary);
+                string svg((istreambuf_iterator<char>(in)), istreambuf_iterator<char>());
+                vector<unsigned char> png;
+                convert(svg.data(), svg.size(), png, options);
+                ofstream(out_file, ios::binary).write((const char *)png.data(), png.size());
+            };
+            // svgtopng reading the standard input and writing the standard
+            // output (with the default options).
+            const string svgtopng = root_path + "/svgtopng";
+            auto piped = [svgtopng](const string &svg_file, const string &out_file, ConvertOptions)
+            {
+                ::pid_t pid = ::fork();
+                if (pid == 0)
+                {
+                    if (!::freopen(svg_file.c_str(), "rb", stdin) || !::freopen(out_file.c_str(), "wb", stdout))
+                    {
+                        ::_exit(1);
+                    }
+                    ::execl(svgtopng.c_str(), "svgtopng", "-", "-", (char *)nullptr);
+                    ::_exit(1);
+                }
+                int child_status = -1;
+                ::waitpid(pid, &child_status, 0);
+            };
+            // Bands of a few rows, for the images to have several,
+            // written as they are drawn.
+            auto banded = [](int rows)
+            {
+                return [rows](const string &svg_file, const string &out_file, ConvertOptions options)
+                {
+                    options.band_height = rows;
+                    convert(svg_file, out_file, options);
+                };
+            };
+            return {
+                {"lion", "banded", banded(7), false},
+                {"aa_shapes", "banded", banded(5), false},
+                {"rgba_shapes", "banded", banded(3), false},
+                {"rgba_aa_shapes", "banded", banded(16), false},
+                {"lion", "memory", in_memory, true},
+                {"rgba_aa_shapes", "memory", in_memory, true},
+                {"batman", "stdio", piped, true},
+            };
+        }
+
+        // Document that must be rejected, with any number of threads.
+        struct Malformed
+        {
+            // Name of the test.
+            string name;
+            // SVG document.
+            string svg;
+        };
+
+        static vector<Malformed> malformed()
+        {
+            // Stray end tag among the children of a document large enough
+            // to be read in parallel.
+            string stray_end_tag = "<svg width=\"100\" height=\"100\" xmlns=\"http://www.w3.org/2000/svg\">\n";
+            for (int i = 0; i < 10000; i++)
+            {
+                stray_end_tag += "  <rect x=\"" + to_string(i % 90) + "\" y=\"" + to_string(i % 80) +
+                                 "\" width=\"10\" height=\"20\" fill=\"red\"/>\n";
+            }
+            stray_end_tag += "  </g>\n  <rect x=\"0\" y=\"0\" width=\"100\" height=\"100\" fill=\"blue\"/>\n</svg>\n";
+            return {
+                {"malformed_stray_end_tag", stray_end_tag},
+                {"malformed_zero_height", "<svg width=\"100\" height=\"0\" xmlns=\"http://www.w3.org/2000/svg\"/>\n"},
+            };
+        }
+
+        bool run_malformed_test(const Malformed &document, unsigned threads)
+        {
+            ConvertOptions options;
+            options.threads = threads;
+            vector<unsigned char> png;
+            try
+            {
+                convert(document.svg.data(), document.svg.size(), png, options);
+            }
+            catch (const runtime_error &e)
+            {
+                cout << "Rejected: " << e.what() << endl;
+                return true;
+            }
+            cout << "Converted a malformed document with " << threads << " threads" << endl;
+            return false;
+        }
+
+        bool run_variant_test(const Variant &variant)
+        {
+            string svg_file = root_path + "/input/" + variant.id + ".svg";
+            string ref_file = root_path + "/output/" + variant.id + ".png";
+            string out_file = root_path + "/output/" + variant.id + "_" + variant.name + ".png";
+            ConvertOptions options = test_options(variant.id);
+            convert(svg_file, ref_file, options);
+            variant.run(svg_file, out_file, options);
+            if (!variant.same_bytes)
+            {
+                return same_channels(ref_file, out_file, 0);
+            }
+            ifstream ref(ref_file, ios::binary), out(out_file, ios::binary);
+            if (!equal(istreambuf_iterator<char>(ref), istreambuf_iterator<char>(),
+                       istreambuf_iterator<char>(out)) ||
+                out.peek() != EOF)
+            {
+                cout << "Files differ: " << ref_file << " " << out_file << endl;
+                return false;
+            }
+            return true;
+        }
+
         bool run_conversion_test(const string &id)
         {
             string svg_file = root_path + "/input/" + id + ".svg";
             string exp_file = root_path + "/expected/" + id + ".png";
             string out_file = root_path + "/output/" + id + ".png";
-            convert(svg_file, out_file);
+            ConvertOptions options = test_options(id);
+            convert(svg_file, out_file, options);
+            if (options.format == PixelFormat::RGBA8 && !same_channels(exp_file, out_file, 3))
+            {
+                return false;
+            }
             PNGImage img1(exp_file), img2(out_file);
             int w1 = img1.width(), h1 = img1.height(),
                 w2 = img2.width(), h2 = img2.height();
@@ -88,7 +286,7 @@ namespace svg
             }
         }
 
-        void run_test(const string& id)
+        void run_test(const string& id, const function<bool()> &test)
         {
             int log_fd = ::fileno(log_stream);
             onTestBegin(id);
@@ -99,7 +297,7 @@ namespace svg
             
                 ::dup2(log_fd, 1);
                 ::dup2(log_fd, 2);
-                bool success = run_conversion_test(id);
+                bool success = test();
                 ::exit(success ? 0 : 1);
             }
             else if (pid > 0)
@@ -150,17 +348,52 @@ namespace svg
                 }
             }
             ::closedir(directory);
-            if (scripts_to_execute.empty())
+            vector<Malformed> malformed_to_execute;
+            for (const Malformed &document : malformed())
+            {
+                if (document.name.find(spec) == 0)
+                {
+                    malformed_to_execute.push_back(document);
+                }
+            }
+            if (scripts_to_execute.empty() && malformed_to_execute.empty())
             {
                 cout << "No scripts matched the spec: " << spec << endl;
                 return;
             }
             sort(scripts_to_execute.begin(), scripts_to_execute.end());
 
-            cout << "== " << scripts_to_execute.size() << " tests to execute  ==" << endl;
+            vector<Variant> variants_to_execute;
+            for (const Variant &variant : variants())
+            {
+                if (variant.id.find(spec) == 0)
+                {
+                    variants_to_execute.push_back(variant);
+                }
+            }
+
+            // Malformed documents are read sequentially and in parallel.
+            const unsigned malformed_threads[] = {1, 4};
+
+            cout << "== " << scripts_to_execute.size() + variants_to_execute.size() + 2 * malformed_to_execute.size()
+                 << " tests to execute  ==" << endl;
             for (string id : scripts_to_execute)
             {
-                run_test(id);
+                run_test(id, [&]()
+                         { return run_conversion_test(id); });
+            }
+            for (const Variant &variant : variants_to_execute)
+            {
+                run_test(variant.id + " [" + variant.name + "]", [&]()
+                         { return run_variant_test(variant); });
+            }
+            for (const Malformed &document : malformed_to_execute)
+            {
+                for (unsigned threads : malformed_threads)
+                {
+                    run_test(document.name + " [threads " + to_string(threads) + "]", [&]()
+                             { return run_malformed_test(document, threads); });
+                }
             }
 
             cout << "== TEST EXECUTION SUMMARY ==" << endl